@@ -0,0 +1,209 @@
+#pragma once
+
+#include <windows.h>
+#include <synchapi.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "event.h"
+#include "primitives.h"
+#include "result.h"
+
+#pragma comment(lib, "Synchronization.lib")
+
+namespace wtl
+{
+    namespace details
+    {
+        struct no_spin
+        {
+            template<typename TryAcquire>
+            bool spin(TryAcquire&&) { return false; }
+        };
+
+        // Spins on the state word before blocking. The spin budget follows how long recent waits
+        // actually needed: it grows toward the spin count of successful spins and shrinks when
+        // spinning fails, so events that are usually set late stop burning cycles.
+        class adaptive_spin
+        {
+            static constexpr std::uint32_t min_spin = 16;
+            static constexpr std::uint32_t max_spin = 4000;
+
+            std::atomic<std::uint32_t> m_average{ 100 };
+
+            static bool multiprocessor()
+            {
+                static const bool value = std::thread::hardware_concurrency() > 1;
+                return value;
+            }
+
+        public:
+            template<typename TryAcquire>
+            bool spin(TryAcquire&& tryAcquire)
+            {
+                if (!multiprocessor()) return false;
+
+                auto average = m_average.load(std::memory_order_relaxed);
+                auto limit = std::min(max_spin, average * 2 + min_spin);
+
+                for (std::uint32_t i = 0; i < limit; i++)
+                {
+                    if (tryAcquire())
+                    {
+                        m_average.store(average + (static_cast<std::int32_t>(i - average) / 8), std::memory_order_relaxed);
+                        return true;
+                    }
+
+                    YieldProcessor();
+                }
+
+                m_average.store(average - average / 4, std::memory_order_relaxed);
+                return false;
+            }
+        };
+    }
+
+    // Intra-process event over WaitOnAddress, the Windows counterpart of a futex. Same
+    // create/set/reset/wait surface and wait_result values as wtl::event, but set and reset are
+    // plain atomic stores unless a thread is actually blocked. Not shareable across processes and
+    // not usable with wait_for_multiple_objects; use wtl::event for that.
+    template<typename SpinPolicy>
+    class basic_address_event
+    {
+        struct state
+        {
+            std::atomic<LONG> signaled;
+            std::atomic<LONG> waiters;
+            bool manualReset;
+            SpinPolicy spinner;
+        };
+
+        std::unique_ptr<state> m_state;
+
+        explicit basic_address_event(std::unique_ptr<state>&& s) : m_state(std::move(s)) { }
+
+        bool try_acquire()
+        {
+            if (m_state->manualReset)
+            {
+                return m_state->signaled.load(std::memory_order_acquire) != 0;
+            }
+
+            if (m_state->signaled.load(std::memory_order_relaxed) == 0) return false;
+
+            LONG expected = 1;
+            return m_state->signaled.compare_exchange_strong(expected, 0, std::memory_order_acquire);
+        }
+
+    public:
+        basic_address_event() { }
+
+        basic_address_event(basic_address_event&& other) = default;
+        basic_address_event & operator=(basic_address_event&& other) = default;
+
+        static win32_err_t<basic_address_event> create(bool bInitialState = false, bool bManualReset = false)
+        {
+            std::unique_ptr<state> s(new (std::nothrow) state());
+            if (!s) return ERROR_NOT_ENOUGH_MEMORY;
+
+            s->signaled = bInitialState ? 1 : 0;
+            s->waiters = 0;
+            s->manualReset = bManualReset;
+
+            return win32_err_t<basic_address_event>::success(basic_address_event(std::move(s)));
+        }
+
+        operator bool() const { return m_state != nullptr; }
+
+        win32_err set()
+        {
+            // sequentially consistent store and load pair with the waiter's increment and the
+            // comparison inside WaitOnAddress, so a waiter is either seen here or sees the store
+            m_state->signaled.store(1);
+
+            if (m_state->waiters.load() == 0) return ERROR_SUCCESS;
+
+            if (m_state->manualReset)
+            {
+                ::WakeByAddressAll(&m_state->signaled);
+            }
+            else
+            {
+                ::WakeByAddressSingle(&m_state->signaled);
+            }
+
+            return ERROR_SUCCESS;
+        }
+
+        win32_err reset()
+        {
+            m_state->signaled.store(0, std::memory_order_release);
+
+            return ERROR_SUCCESS;
+        }
+
+        win32_err_t<wait_result> wait(dword_milliseconds timeout = infinite)
+        {
+            if (try_acquire()) return win32_err_t<wait_result>::success(wait_result::signaled);
+            if (timeout.count() == 0) return win32_err_t<wait_result>::success(wait_result::timeout);
+
+            if (m_state->spinner.spin([this] { return try_acquire(); }))
+            {
+                return win32_err_t<wait_result>::success(wait_result::signaled);
+            }
+
+            const auto start = ::GetTickCount64();
+
+            for (;;)
+            {
+                auto remaining = timeout.count();
+                if (timeout != infinite)
+                {
+                    auto elapsed = ::GetTickCount64() - start;
+                    if (elapsed >= timeout.count()) return win32_err_t<wait_result>::success(wait_result::timeout);
+
+                    remaining = static_cast<DWORD>(timeout.count() - elapsed);
+                }
+
+                ++m_state->waiters;
+
+                DWORD err = ERROR_SUCCESS;
+                LONG unsignaled = 0;
+                if (!::WaitOnAddress(&m_state->signaled, &unsignaled, sizeof(unsignaled), remaining))
+                {
+                    err = GetLastError();
+                }
+
+                --m_state->waiters;
+
+                if (err != ERROR_SUCCESS && err != ERROR_TIMEOUT) return err;
+
+                if (try_acquire()) return win32_err_t<wait_result>::success(wait_result::signaled);
+            }
+        }
+
+        // WaitOnAddress only takes whole milliseconds, so this may overshoot the deadline by up
+        // to one millisecond but never returns before it.
+        win32_err_t<wait_result> wait(deadline until)
+        {
+            for (;;)
+            {
+                RETURN_OR_UNWRAP(result, wait(remaining_milliseconds(until)));
+                if (result != wait_result::timeout || std::chrono::steady_clock::now() >= until)
+                {
+                    return win32_err_t<wait_result>::success(result);
+                }
+            }
+        }
+    };
+
+    // Blocks immediately; the cheapest choice when waits are usually long.
+    using address_event = basic_address_event<details::no_spin>;
+
+    // Spins briefly before blocking; for producer/consumer handoffs where the event is usually
+    // set within microseconds of the wait.
+    using light_event = basic_address_event<details::adaptive_spin>;
+}
\ No newline at end of file
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <windows.h>
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#else
+#include <experimental/resumable>
+#endif
+
+#include <exception>
+
+#include "event.h"
+#include "file.h"
+#include "primitives.h"
+#include "resource_handle.h"
+#include "result.h"
+#include "thread_pool.h"
+
+namespace wtl
+{
+    namespace details
+    {
+#if defined(__cpp_impl_coroutine)
+        namespace coro = std;
+#else
+        namespace coro = std::experimental;
+#endif
+
+        // Every operation driven by io_scheduler starts with an OVERLAPPED so the completion
+        // packet can be mapped straight back to the suspended coroutine.
+        struct io_operation
+        {
+            OVERLAPPED ol = {};
+            coro::coroutine_handle<> continuation;
+            DWORD bytesTransferred = 0;
+        };
+
+        constexpr ULONG_PTR stop_key = 1;
+    }
+
+    using completion_port = resource_handle<HANDLE, int, NULL, decltype(::CloseHandle), ::CloseHandle>;
+
+    // Completion-port backed scheduler. Any number of threads may call run(); each one dequeues
+    // completions in batches and resumes the coroutines waiting on them.
+    class io_scheduler
+    {
+        completion_port m_port;
+
+        explicit io_scheduler(completion_port&& port) : m_port(std::move(port)) { }
+
+    public:
+        static constexpr ULONG default_batch_size = 64;
+
+        io_scheduler(io_scheduler&& other) = default;
+        io_scheduler & operator=(io_scheduler&& other) = default;
+
+        static win32_err_t<io_scheduler> create(DWORD concurrency = 0)
+        {
+            completion_port port = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, concurrency);
+            if (!port) return GetLastError();
+
+            return win32_err_t<io_scheduler>::success(io_scheduler(std::move(port)));
+        }
+
+        // The handle must have been opened with FILE_FLAG_OVERLAPPED. Operations that complete
+        // synchronously do not queue a packet and resume without suspending.
+        win32_err associate(HANDLE h)
+        {
+            if (!::CreateIoCompletionPort(h, m_port.get(), 0, 0)) return GetLastError();
+            if (!::SetFileCompletionNotificationModes(h, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE)) return GetLastError();
+
+            return ERROR_SUCCESS;
+        }
+
+        win32_err associate(file const & f)
+        {
+            return associate(f.get());
+        }
+
+        win32_err post(details::io_operation * op, DWORD bytesTransferred = 0)
+        {
+            if (!::PostQueuedCompletionStatus(m_port.get(), bytesTransferred, 0, &op->ol)) return GetLastError();
+
+            return ERROR_SUCCESS;
+        }
+
+        // Makes one thread blocked in run() return.
+        win32_err stop()
+        {
+            if (!::PostQueuedCompletionStatus(m_port.get(), 0, details::stop_key, nullptr)) return GetLastError();
+
+            return ERROR_SUCCESS;
+        }
+
+        // Dequeues and resumes at most one batch. Returns the number of operations resumed, or
+        // ERROR_CANCELLED if a stop request was dequeued. A batch that picked up several stop
+        // requests consumes one and puts the others back for the other threads.
+        win32_err_t<ULONG> run_once(dword_milliseconds timeout = infinite, ULONG batchSize = default_batch_size)
+        {
+            OVERLAPPED_ENTRY entries[default_batch_size];
+            if (batchSize > default_batch_size) batchSize = default_batch_size;
+
+            ULONG count = 0;
+            if (!::GetQueuedCompletionStatusEx(m_port.get(), entries, batchSize, &count, timeout.count(), FALSE))
+            {
+                auto err = GetLastError();
+                if (err == WAIT_TIMEOUT) return win32_err_t<ULONG>::success(0);
+
+                return err;
+            }
+
+            ULONG stops = 0;
+            ULONG resumed = 0;
+
+            for (ULONG i = 0; i < count; i++)
+            {
+                if (entries[i].lpCompletionKey == details::stop_key)
+                {
+                    stops++;
+                    continue;
+                }
+
+                auto op = reinterpret_cast<details::io_operation *>(entries[i].lpOverlapped);
+                op->bytesTransferred = entries[i].dwNumberOfBytesTransferred;
+                op->continuation.resume();
+                resumed++;
+            }
+
+            if (stops != 0)
+            {
+                for (ULONG i = 1; i < stops; i++)
+                {
+                    auto reposted = stop();
+                    if (!reposted) return reposted;
+                }
+
+                return ERROR_CANCELLED;
+            }
+
+            return win32_err_t<ULONG>::success(resumed);
+        }
+
+        // Resumes completions until stop() is called.
+        win32_err run()
+        {
+            for (;;)
+            {
+                auto result = run_once();
+                if (!result)
+                {
+                    if (result.get_result() == ERROR_CANCELLED) return ERROR_SUCCESS;
+
+                    return result.get_result();
+                }
+            }
+        }
+
+        HANDLE get() const
+        {
+            return m_port.get();
+        }
+    };
+
+    class read_awaitable : details::io_operation
+    {
+        HANDLE m_file;
+        void * m_buffer;
+        DWORD m_size;
+        DWORD m_error = ERROR_SUCCESS;
+
+    public:
+        read_awaitable(HANDLE file, void * buffer, DWORD size, std::uint64_t offset) :
+            m_file(file), m_buffer(buffer), m_size(size)
+        {
+            ol.Offset = static_cast<DWORD>(offset);
+            ol.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        bool await_suspend(details::coro::coroutine_handle<> handle)
+        {
+            continuation = handle;
+
+            if (::ReadFile(m_file, m_buffer, m_size, &bytesTransferred, &ol))
+            {
+                return false;
+            }
+
+            auto err = GetLastError();
+            if (err == ERROR_IO_PENDING) return true;
+
+            m_error = err;
+            return false;
+        }
+
+        win32_err_t<DWORD> await_resume()
+        {
+            if (m_error == ERROR_HANDLE_EOF) return win32_err_t<DWORD>::success(0);
+            if (m_error != ERROR_SUCCESS) return m_error;
+
+            DWORD bytes;
+            if (!::GetOverlappedResult(m_file, &ol, &bytes, FALSE))
+            {
+                auto err = GetLastError();
+                if (err == ERROR_HANDLE_EOF) return win32_err_t<DWORD>::success(0);
+
+                return err;
+            }
+
+            return win32_err_t<DWORD>::success(bytes);
+        }
+    };
+
+    template<typename It>
+    read_awaitable async_read(file & f, It begin, It end, std::uint64_t offset)
+    {
+        static_assert(std::is_same<std::random_access_iterator_tag, typename std::iterator_traits<It>::iterator_category>::value,
+            "async_read must provide random access iterators.");
+
+        auto size = (end - begin) * sizeof(decltype(*begin));
+        return read_awaitable(f.get(), static_cast<void *>(&*begin), static_cast<DWORD>(size), offset);
+    }
+
+    // Waits on any waitable handle through the thread pool, then resumes on the scheduler.
+    class wait_awaitable : details::io_operation
+    {
+        io_scheduler * m_scheduler;
+        HANDLE m_handle;
+        dword_milliseconds m_timeout;
+        PTP_WAIT m_wait = nullptr;
+        wait_result m_result = wait_result::failed;
+        DWORD m_error = ERROR_SUCCESS;
+
+        static void CALLBACK on_wait(PTP_CALLBACK_INSTANCE, PVOID context, PTP_WAIT, TP_WAIT_RESULT waitResult)
+        {
+            auto self = static_cast<wait_awaitable *>(context);
+            self->m_result = waitResult == WAIT_TIMEOUT ? wait_result::timeout : wait_result::signaled;
+
+            if (!::PostQueuedCompletionStatus(self->m_scheduler->get(), 0, 0, &self->ol))
+            {
+                // nothing will resume the coroutine through the port; resume it here
+                self->m_error = GetLastError();
+                self->continuation.resume();
+            }
+        }
+
+    public:
+        wait_awaitable(io_scheduler & scheduler, HANDLE handle, dword_milliseconds timeout) :
+            m_scheduler(&scheduler), m_handle(handle), m_timeout(timeout)
+        {
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        bool await_suspend(details::coro::coroutine_handle<> handle)
+        {
+            continuation = handle;
+
+            // the wait can fire, and the coroutine resume and finish, as soon as it is armed;
+            // everything the frame needs afterwards has to be in place before that
+            m_wait = ::CreateThreadpoolWait(on_wait, this, nullptr);
+            if (!m_wait)
+            {
+                m_error = GetLastError();
+                return false;
+            }
+
+            FILETIME storage;
+            ::SetThreadpoolWait(m_wait, m_handle, details::to_relative_filetime(m_timeout, storage));
+
+            return true;
+        }
+
+        win32_err_t<wait_result> await_resume()
+        {
+            if (m_wait)
+            {
+                // the callback may still be returning; the pool frees the wait once it has
+                ::CloseThreadpoolWait(m_wait);
+                m_wait = nullptr;
+            }
+
+            if (m_error != ERROR_SUCCESS) return m_error;
+
+            return win32_err_t<wait_result>::success(m_result);
+        }
+    };
+
+    inline wait_awaitable async_wait(io_scheduler & scheduler, event const & e, dword_milliseconds timeout = infinite)
+    {
+        return wait_awaitable(scheduler, e.get(), timeout);
+    }
+
+    // Coroutine return type for operations nobody awaits; the frame frees itself on completion.
+    struct detached_task
+    {
+        struct promise_type
+        {
+            detached_task get_return_object() noexcept { return {}; }
+
+            details::coro::suspend_never initial_suspend() noexcept { return {}; }
+
+            details::coro::suspend_never final_suspend() noexcept { return {}; }
+
+            void return_void() noexcept { }
+
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    };
+}
\ No newline at end of file
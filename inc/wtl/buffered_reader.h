@@ -0,0 +1,271 @@
+#pragma once
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "event.h"
+#include "file.h"
+#include "result.h"
+
+namespace wtl
+{
+    // Sequential reader over an overlapped file handle. Keeps several buffers in flight so the
+    // device is already filling the next one while the caller copies out of the current one.
+    class buffered_reader
+    {
+        struct slot
+        {
+            std::unique_ptr<std::uint8_t[]> buffer;
+            event completion;
+            overlapped ol;
+            DWORD valid = 0;
+            DWORD position = 0;
+            DWORD error = ERROR_SUCCESS;
+            bool pending = false;
+            bool ready = false;
+        };
+
+        file m_file;
+        std::unique_ptr<slot[]> m_slots;
+        DWORD m_slotCount = 0;
+        DWORD m_bufferSize = 0;
+        DWORD m_current = 0;
+        std::uint64_t m_nextOffset = 0;
+        bool m_endIssued = false;
+
+        // The first failed read. Later reads return it instead of looking like the end of file.
+        DWORD m_error = ERROR_SUCCESS;
+
+        template<typename T>
+        T * addressof(T& ref) { return &ref; }
+
+        buffered_reader(file&& f, DWORD bufferSize, DWORD bufferCount) :
+            m_file(std::move(f)),
+            m_slots(new slot[bufferCount]),
+            m_slotCount(bufferCount),
+            m_bufferSize(bufferSize)
+        {
+        }
+
+        void issue(slot & s)
+        {
+            s.valid = 0;
+            s.position = 0;
+            s.ready = false;
+
+            if (m_endIssued)
+            {
+                s.pending = false;
+                return;
+            }
+
+            s.ol = overlapped::at(m_nextOffset, s.completion.get());
+            m_nextOffset += m_bufferSize;
+
+            if (!::ReadFile(m_file.get(), s.buffer.get(), m_bufferSize, nullptr, s.ol.get()))
+            {
+                auto err = GetLastError();
+                if (err != ERROR_IO_PENDING)
+                {
+                    s.pending = false;
+                    m_endIssued = true;
+
+                    if (err != ERROR_HANDLE_EOF)
+                    {
+                        s.error = err;
+                    }
+
+                    return;
+                }
+            }
+
+            s.pending = true;
+        }
+
+        win32_err complete(slot & s)
+        {
+            if (s.pending)
+            {
+                DWORD bytesTransferred = 0;
+                if (!::GetOverlappedResult(m_file.get(), s.ol.get(), &bytesTransferred, TRUE))
+                {
+                    auto err = GetLastError();
+                    if (err != ERROR_HANDLE_EOF)
+                    {
+                        s.error = err;
+                    }
+
+                    bytesTransferred = 0;
+                }
+
+                s.pending = false;
+                s.valid = bytesTransferred;
+
+                if (s.valid < m_bufferSize)
+                {
+                    m_endIssued = true;
+                }
+            }
+
+            s.ready = true;
+
+            if (s.error != ERROR_SUCCESS && m_error == ERROR_SUCCESS)
+            {
+                m_error = s.error;
+            }
+
+            return s.error;
+        }
+
+        void cancel_all()
+        {
+            if (!m_slots) return;
+
+            for (DWORD i = 0; i < m_slotCount; i++)
+            {
+                auto & s = m_slots[i];
+                if (s.pending)
+                {
+                    DWORD ignored;
+                    ::CancelIoEx(m_file.get(), s.ol.get());
+                    ::GetOverlappedResult(m_file.get(), s.ol.get(), &ignored, TRUE);
+                    s.pending = false;
+                }
+            }
+        }
+
+    public:
+        static constexpr DWORD default_buffer_size = 1024 * 1024;
+        static constexpr DWORD default_buffer_count = 3;
+
+        buffered_reader(buffered_reader&& other) = default;
+
+        buffered_reader & operator=(buffered_reader&& other)
+        {
+            cancel_all();
+
+            m_file = std::move(other.m_file);
+            m_slots = std::move(other.m_slots);
+            m_slotCount = other.m_slotCount;
+            m_bufferSize = other.m_bufferSize;
+            m_current = other.m_current;
+            m_nextOffset = other.m_nextOffset;
+            m_endIssued = other.m_endIssued;
+            m_error = other.m_error;
+
+            return *this;
+        }
+
+        ~buffered_reader()
+        {
+            cancel_all();
+        }
+
+        // Takes ownership of a handle that was opened with FILE_FLAG_OVERLAPPED.
+        static win32_err_t<buffered_reader> attach(
+            file&& overlappedFile,
+            DWORD bufferSize = default_buffer_size,
+            DWORD bufferCount = default_buffer_count,
+            std::uint64_t startOffset = 0)
+        {
+            if (!overlappedFile || bufferSize == 0 || bufferCount < 2) return ERROR_INVALID_PARAMETER;
+
+            auto reader = buffered_reader(std::move(overlappedFile), bufferSize, bufferCount);
+            reader.m_nextOffset = startOffset;
+
+            for (DWORD i = 0; i < bufferCount; i++)
+            {
+                auto & s = reader.m_slots[i];
+
+                s.buffer.reset(new (std::nothrow) std::uint8_t[bufferSize]);
+                if (!s.buffer) return ERROR_NOT_ENOUGH_MEMORY;
+
+                RETURN_OR_UNWRAP(completion, event::create(false, true));
+                s.completion = std::move(completion);
+            }
+
+            for (DWORD i = 0; i < bufferCount; i++)
+            {
+                reader.issue(reader.m_slots[i]);
+            }
+
+            return win32_err_t<buffered_reader>::success(std::move(reader));
+        }
+
+        static win32_err_t<buffered_reader> open(
+            _In_ PCWSTR fileName,
+            DWORD bufferSize = default_buffer_size,
+            DWORD bufferCount = default_buffer_count,
+            DWORD shareMode = FILE_SHARE_READ,
+            DWORD flagsAndAttributes = FILE_ATTRIBUTE_NORMAL)
+        {
+            RETURN_OR_UNWRAP(f, file::create(
+                fileName,
+                GENERIC_READ,
+                shareMode,
+                nullptr,
+                OPEN_EXISTING,
+                flagsAndAttributes | FILE_FLAG_SEQUENTIAL_SCAN | FILE_FLAG_OVERLAPPED));
+
+            return attach(std::move(f), bufferSize, bufferCount);
+        }
+
+        // Copies up to (end - begin) elements into the range. Fewer bytes than requested
+        // (including zero) are only returned at the end of the file. Once a read has failed every
+        // later call returns the same error.
+        template<typename It>
+        win32_err read(It begin, It end, _Out_opt_ DWORD * bytesRead = nullptr)
+        {
+            static_assert(std::is_same<std::random_access_iterator_tag, typename std::iterator_traits<It>::iterator_category>::value,
+                "buffered_reader::read must provide random access iterators.");
+
+            if (bytesRead) *bytesRead = 0;
+
+            if (m_error != ERROR_SUCCESS) return m_error;
+
+            const auto size = static_cast<size_t>((end - begin) * sizeof(decltype(*begin)));
+            if (size == 0) return ERROR_SUCCESS;
+
+            auto out = reinterpret_cast<std::uint8_t *>(addressof(*begin));
+            size_t total = 0;
+
+            while (total < size)
+            {
+                auto & current = m_slots[m_current];
+
+                if (!current.ready)
+                {
+                    auto completed = complete(current);
+                    if (!completed) return completed;
+                }
+
+                if (current.position == current.valid)
+                {
+                    if (current.valid < m_bufferSize) break;
+
+                    issue(current);
+                    m_current = (m_current + 1) % m_slotCount;
+                    continue;
+                }
+
+                auto count = std::min<size_t>(size - total, current.valid - current.position);
+                std::memcpy(out + total, current.buffer.get() + current.position, count);
+
+                current.position += static_cast<DWORD>(count);
+                total += count;
+            }
+
+            if (bytesRead) *bytesRead = static_cast<DWORD>(total);
+
+            return ERROR_SUCCESS;
+        }
+
+        HANDLE get() const
+        {
+            return m_file.get();
+        }
+    };
+}
\ No newline at end of file
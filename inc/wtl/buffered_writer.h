@@ -0,0 +1,434 @@
+#pragma once
+
+#include <windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "event.h"
+#include "file.h"
+#include "primitives.h"
+#include "result.h"
+
+namespace wtl
+{
+    namespace details
+    {
+        struct write_record
+        {
+            write_record * next = nullptr;
+            std::vector<std::uint8_t> data;
+
+            // flush requests carry no data; the worker signals 'done' once everything queued
+            // ahead of them has been written. The requesting thread and the worker both let go
+            // of a flush record, and whichever does so second frees it.
+            bool is_flush = false;
+            bool durable = false;
+            event done;
+            DWORD result = ERROR_SUCCESS;
+            std::atomic<bool> released{ false };
+
+            static void release(write_record * record)
+            {
+                if (record->released.exchange(true)) delete record;
+            }
+        };
+    }
+
+    // Coalesces small appends into block-sized WriteFile calls. Block boundaries are aligned to
+    // the file offset, so after the first block every write starts on a multiple of blockSize.
+    //
+    // Without a background thread the writer is not thread safe and the deadline is only checked
+    // on append. With a background thread any number of threads may append concurrently; records
+    // are pushed onto a lock-free list and the worker writes them out in order.
+    class buffered_writer
+    {
+        struct state
+        {
+            file f;
+            std::unique_ptr<std::uint8_t[]> block;
+            DWORD blockSize = 0;
+            DWORD used = 0;
+            std::uint64_t offset = 0;
+            dword_milliseconds maxDelay = infinite;
+            std::chrono::steady_clock::time_point firstPending;
+            std::atomic<DWORD> error{ ERROR_SUCCESS };
+
+            std::atomic<details::write_record *> head{ nullptr };
+            event wake;
+            std::atomic<bool> stopping{ false };
+            std::thread worker;
+
+            DWORD block_limit() const
+            {
+                return blockSize - static_cast<DWORD>(offset % blockSize);
+            }
+
+            bool deadline_passed(std::chrono::steady_clock::time_point now) const
+            {
+                return used != 0 && maxDelay != infinite && now - firstPending >= maxDelay;
+            }
+
+            win32_err write_all(std::uint8_t const * data, size_t size)
+            {
+                while (size != 0)
+                {
+                    DWORD written = 0;
+                    auto chunk = static_cast<DWORD>(std::min<size_t>(size, MAXDWORD));
+                    auto result = f.write(data, data + chunk, &written);
+                    if (!result) return result;
+
+                    data += written;
+                    size -= written;
+                    offset += written;
+                }
+
+                return ERROR_SUCCESS;
+            }
+
+            win32_err write_block()
+            {
+                if (used == 0) return ERROR_SUCCESS;
+
+                auto result = write_all(block.get(), used);
+                used = 0;
+
+                return result;
+            }
+
+            win32_err buffer(std::uint8_t const * data, size_t size)
+            {
+                while (size != 0)
+                {
+                    // whole aligned blocks skip the copy
+                    if (used == 0 && offset % blockSize == 0 && size >= blockSize)
+                    {
+                        auto direct = size - size % blockSize;
+                        auto result = write_all(data, direct);
+                        if (!result) return result;
+
+                        data += direct;
+                        size -= direct;
+                        continue;
+                    }
+
+                    if (used == 0)
+                    {
+                        firstPending = std::chrono::steady_clock::now();
+                    }
+
+                    auto count = std::min<size_t>(size, block_limit() - used);
+                    std::memcpy(block.get() + used, data, count);
+
+                    used += static_cast<DWORD>(count);
+                    data += count;
+                    size -= count;
+
+                    if (used == block_limit())
+                    {
+                        auto result = write_block();
+                        if (!result) return result;
+                    }
+                }
+
+                return ERROR_SUCCESS;
+            }
+
+            win32_err flush(bool durable)
+            {
+                auto result = write_block();
+                if (result && durable)
+                {
+                    result = f.flush_buffers();
+                }
+
+                return result;
+            }
+
+            void record_error(win32_err result)
+            {
+                if (!result)
+                {
+                    DWORD expected = ERROR_SUCCESS;
+                    error.compare_exchange_strong(expected, result.get_result());
+                }
+            }
+
+            void push(details::write_record * record)
+            {
+                record->next = head.load(std::memory_order_relaxed);
+                while (!head.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed));
+
+                // only the producer that makes the list non-empty needs to wake the worker
+                if (record->next == nullptr)
+                {
+                    wake.set();
+                }
+            }
+
+            void process(details::write_record * list)
+            {
+                // the list was built by pushing onto the front; restore append order
+                details::write_record * ordered = nullptr;
+                while (list)
+                {
+                    auto next = list->next;
+                    list->next = ordered;
+                    ordered = list;
+                    list = next;
+                }
+
+                while (ordered)
+                {
+                    std::unique_ptr<details::write_record> record(ordered);
+                    ordered = record->next;
+
+                    if (record->is_flush)
+                    {
+                        // after a failure later data records were dropped; every flush has to
+                        // report that rather than flushing what little is left
+                        DWORD result = error;
+                        if (result == ERROR_SUCCESS)
+                        {
+                            auto flushed = flush(record->durable);
+                            record_error(flushed);
+                            result = flushed.get_result();
+                        }
+
+                        auto done = record.release();
+                        done->result = result;
+                        done->done.set();
+                        details::write_record::release(done);
+                    }
+                    else if (error == ERROR_SUCCESS)
+                    {
+                        record_error(buffer(record->data.data(), record->data.size()));
+                    }
+                }
+            }
+
+            void run()
+            {
+                for (;;)
+                {
+                    auto timeout = infinite;
+                    if (used != 0 && maxDelay != infinite)
+                    {
+                        auto elapsed = std::chrono::duration_cast<dword_milliseconds>(std::chrono::steady_clock::now() - firstPending);
+                        timeout = elapsed >= maxDelay ? dword_milliseconds(0) : maxDelay - elapsed;
+                    }
+
+                    wake.wait(timeout);
+
+                    process(head.exchange(nullptr, std::memory_order_acquire));
+
+                    if (deadline_passed(std::chrono::steady_clock::now()))
+                    {
+                        record_error(write_block());
+                    }
+
+                    if (stopping && head.load(std::memory_order_acquire) == nullptr)
+                    {
+                        record_error(write_block());
+                        return;
+                    }
+                }
+            }
+        };
+
+        std::unique_ptr<state> m_state;
+
+        explicit buffered_writer(std::unique_ptr<state>&& s) : m_state(std::move(s)) { }
+
+        template<typename T>
+        T * addressof(T& ref) { return &ref; }
+
+    public:
+        static constexpr DWORD default_block_size = 64 * 1024;
+
+        buffered_writer(buffered_writer&& other) = default;
+
+        buffered_writer & operator=(buffered_writer&& other)
+        {
+            close();
+            m_state = std::move(other.m_state);
+
+            return *this;
+        }
+
+        ~buffered_writer()
+        {
+            close();
+        }
+
+        // Stops the background thread, if any, and writes out whatever is still buffered.
+        void close()
+        {
+            if (!m_state) return;
+
+            if (m_state->worker.joinable())
+            {
+                m_state->stopping = true;
+                m_state->wake.set();
+                m_state->worker.join();
+            }
+            else
+            {
+                m_state->write_block();
+            }
+
+            m_state.reset();
+        }
+
+        // Takes ownership of a synchronous (non-overlapped) handle. Appends start at the
+        // handle's current file pointer.
+        static win32_err_t<buffered_writer> attach(
+            file&& f,
+            DWORD blockSize = default_block_size,
+            dword_milliseconds maxDelay = infinite,
+            bool backgroundFlush = false)
+        {
+            if (!f || blockSize == 0) return ERROR_INVALID_PARAMETER;
+
+            std::unique_ptr<state> s(new (std::nothrow) state());
+            if (!s) return ERROR_NOT_ENOUGH_MEMORY;
+
+            s->block.reset(new (std::nothrow) std::uint8_t[blockSize]);
+            if (!s->block) return ERROR_NOT_ENOUGH_MEMORY;
+
+            LARGE_INTEGER position = {};
+            if (!::SetFilePointerEx(f.get(), position, &position, FILE_CURRENT)) return GetLastError();
+
+            s->f = std::move(f);
+            s->blockSize = blockSize;
+            s->maxDelay = maxDelay;
+            s->offset = static_cast<std::uint64_t>(position.QuadPart);
+
+            if (backgroundFlush)
+            {
+                RETURN_OR_UNWRAP(wake, event::create());
+                s->wake = std::move(wake);
+
+                auto raw = s.get();
+                s->worker = std::thread([raw] { raw->run(); });
+            }
+
+            return win32_err_t<buffered_writer>::success(buffered_writer(std::move(s)));
+        }
+
+        static win32_err_t<buffered_writer> open(
+            _In_ PCWSTR fileName,
+            DWORD creationDisposition = OPEN_ALWAYS,
+            DWORD blockSize = default_block_size,
+            dword_milliseconds maxDelay = infinite,
+            bool backgroundFlush = false,
+            DWORD shareMode = FILE_SHARE_READ)
+        {
+            RETURN_OR_UNWRAP(f, file::create(
+                fileName,
+                GENERIC_WRITE,
+                shareMode,
+                nullptr,
+                creationDisposition,
+                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN));
+
+            LARGE_INTEGER end = {};
+            if (!::SetFilePointerEx(f.get(), end, nullptr, FILE_END)) return GetLastError();
+
+            return attach(std::move(f), blockSize, maxDelay, backgroundFlush);
+        }
+
+        template<typename It>
+        win32_err append(It begin, It end)
+        {
+            static_assert(std::is_same<std::random_access_iterator_tag, typename std::iterator_traits<It>::iterator_category>::value,
+                "buffered_writer::append must provide random access iterators.");
+
+            DWORD err = m_state->error;
+            if (err != ERROR_SUCCESS) return err;
+
+            const auto size = static_cast<size_t>((end - begin) * sizeof(decltype(*begin)));
+            if (size == 0) return ERROR_SUCCESS;
+
+            auto data = reinterpret_cast<std::uint8_t const *>(addressof(*begin));
+
+            if (m_state->worker.joinable())
+            {
+                std::unique_ptr<details::write_record> record(new (std::nothrow) details::write_record());
+                if (!record) return ERROR_NOT_ENOUGH_MEMORY;
+
+                record->data.assign(data, data + size);
+                m_state->push(record.release());
+
+                return ERROR_SUCCESS;
+            }
+
+            auto result = m_state->buffer(data, size);
+            if (result && m_state->deadline_passed(std::chrono::steady_clock::now()))
+            {
+                result = m_state->write_block();
+            }
+
+            m_state->record_error(result);
+
+            return result;
+        }
+
+        // Hands everything appended so far to the OS.
+        win32_err flush()
+        {
+            return flush(false);
+        }
+
+        // Like flush, then waits for the data to reach the device (FlushFileBuffers).
+        win32_err sync()
+        {
+            return flush(true);
+        }
+
+        win32_err flush(bool durable)
+        {
+            if (!m_state->worker.joinable())
+            {
+                DWORD err = m_state->error;
+                if (err != ERROR_SUCCESS) return err;
+
+                auto result = m_state->flush(durable);
+                m_state->record_error(result);
+
+                return result;
+            }
+
+            std::unique_ptr<details::write_record> record(new (std::nothrow) details::write_record());
+            if (!record) return ERROR_NOT_ENOUGH_MEMORY;
+
+            RETURN_OR_UNWRAP(done, event::create(false, true));
+
+            record->is_flush = true;
+            record->durable = durable;
+            record->done = std::move(done);
+
+            // the record, and the event in it, stay alive until the worker has signaled it,
+            // even if the wait here fails
+            auto request = record.release();
+            m_state->push(request);
+
+            auto waited = request->done.wait();
+            DWORD result = waited ? request->result : waited.get_result();
+
+            details::write_record::release(request);
+
+            return result;
+        }
+
+        HANDLE get() const
+        {
+            return m_state->f.get();
+        }
+    };
+}
\ No newline at end of file
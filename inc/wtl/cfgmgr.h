@@ -3,6 +3,9 @@
 #include <Windows.h>
 #include <cfgmgr32.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "resource_handle.h"
 #include "result.h"
 #include "multi_sz.h"
@@ -15,8 +18,12 @@
     } \
 } REQUIRE_SEMICOLON
 
+#pragma comment(lib, "cfgmgr32.lib")
+
 namespace wtl
 {
+    using hcmnotification = resource_handle<HCMNOTIFICATION, int, 0, decltype(::CM_Unregister_Notification), ::CM_Unregister_Notification>;
+
     namespace cm
     {
         static configret_t<ULONG> get_device_interface_list_size(GUID const & classGuid, PCWSTR pDeviceId = nullptr, ULONG flags = 0)
@@ -27,15 +34,67 @@ namespace wtl
             return configret_t<ULONG>::success(size);
         }
 
+        // Fills 'buffer' with the interface list, reusing whatever capacity it already has. The
+        // fetch is tried directly and only falls back to a size query on CR_BUFFER_SMALL, which
+        // also covers interfaces arriving between the size query and the fetch. In steady state
+        // this is one config manager call and no allocation. The view points into 'buffer'.
+        static configret_t<wtl::multi_sz_view> get_device_interface_list(std::vector<wchar_t> & buffer, GUID const & classGuid, PCWSTR pDeviceId = nullptr, ULONG flags = 0)
+        {
+            buffer.resize(buffer.capacity());
+
+            for (;;)
+            {
+                if (!buffer.empty())
+                {
+                    auto cr = CM_Get_Device_Interface_ListW((LPGUID)&classGuid, (DEVINSTID_W)pDeviceId, buffer.data(), static_cast<ULONG>(buffer.size()), flags);
+                    if (cr == CR_SUCCESS) return configret_t<wtl::multi_sz_view>::success(wtl::multi_sz_view(buffer.data()));
+                    if (cr != CR_BUFFER_SMALL) return cr;
+                }
+
+                RETURN_OR_UNWRAP(size, get_device_interface_list_size(classGuid, pDeviceId, flags));
+
+                // leave headroom for interfaces that arrive before the retry
+                buffer.resize(std::max<size_t>(size + size / 4, buffer.size() * 2));
+            }
+        }
+
+        // Same as above with a per-thread buffer. The view is valid until the next call on the
+        // same thread.
+        static configret_t<wtl::multi_sz_view> get_device_interface_list_view(GUID const & classGuid, PCWSTR pDeviceId = nullptr, ULONG flags = 0)
+        {
+            thread_local std::vector<wchar_t> buffer;
+
+            return get_device_interface_list(buffer, classGuid, pDeviceId, flags);
+        }
+
         static configret_t<wtl::multi_sz> get_device_interface_list(GUID const & classGuid, PCWSTR pDeviceId = nullptr, ULONG flags = 0)
         {
             RETURN_OR_UNWRAP(size, get_device_interface_list_size(classGuid, pDeviceId, flags));
 
-            std::vector<wchar_t> buffer(size, L'\0');
+            std::vector<wchar_t> buffer;
+            buffer.reserve(size);
+
+            RETURN_OR_UNWRAP(view, get_device_interface_list(buffer, classGuid, pDeviceId, flags));
+
+            // trim to the list's own terminator so the buffer is a valid multi_sz
+            buffer.resize(find_last(buffer.data()) - buffer.data() + 1);
+
+            return configret_t<wtl::multi_sz>::success(wtl::multi_sz(std::move(buffer)));
+        }
+
+        // Calls back on a system thread whenever an interface of the class arrives or is removed.
+        // Closing the handle waits for callbacks in progress, so it must not happen inside one.
+        static configret_t<hcmnotification> register_interface_notification(GUID const & classGuid, PCM_NOTIFY_CALLBACK callback, PVOID context)
+        {
+            CM_NOTIFY_FILTER filter = {};
+            filter.cbSize = sizeof(filter);
+            filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+            filter.u.DeviceInterface.ClassGuid = classGuid;
 
-            RETURN_IF_NOT_CR_SUCCESS(CM_Get_Device_Interface_ListW((LPGUID)&classGuid, (DEVINSTID_W)pDeviceId, &buffer[0], size, flags));
+            HCMNOTIFICATION notification;
+            RETURN_IF_NOT_CR_SUCCESS(CM_Register_Notification(&filter, context, callback, &notification));
 
-            return configret_t<wtl::multi_sz>::success(std::move(buffer));
+            return configret_t<hcmnotification>::success(hcmnotification(notification));
         }
 
         static DWORD map_configret_to_win32_err(CONFIGRET cr, DWORD defaultError = ERROR_INVALID_FUNCTION)
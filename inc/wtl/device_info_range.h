@@ -0,0 +1,243 @@
+#pragma once
+
+#include <Windows.h>
+#include <SetupAPI.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "result.h"
+#include "setup_di.h"
+
+namespace wtl
+{
+    struct device_property
+    {
+        DWORD type;
+        BYTE const * data;
+        DWORD size;
+    };
+
+    namespace details
+    {
+        struct property_slot
+        {
+            DWORD error;
+            DWORD type;
+            size_t offset;
+            DWORD size;
+        };
+
+        // Appends one registry property of a device to 'arena'. The property is read straight
+        // into the arena's tail; a size probe only happens when it does not fit.
+        inline property_slot append_registry_property(HDEVINFO deviceInfoSet, SP_DEVINFO_DATA & devInfoData, DWORD property, std::vector<BYTE> & arena)
+        {
+            property_slot slot = { ERROR_SUCCESS, REG_NONE, arena.size(), 0 };
+            DWORD available = 256;
+
+            for (;;)
+            {
+                arena.resize(slot.offset + available);
+
+                DWORD required = 0;
+                if (SetupDiGetDeviceRegistryPropertyW(deviceInfoSet, &devInfoData, property, &slot.type, arena.data() + slot.offset, available, &required))
+                {
+                    slot.size = required;
+                    break;
+                }
+
+                auto err = GetLastError();
+                if (err != ERROR_INSUFFICIENT_BUFFER)
+                {
+                    slot.error = err;
+                    break;
+                }
+
+                available = required;
+            }
+
+            arena.resize(slot.offset + slot.size);
+
+            return slot;
+        }
+    }
+
+    // Forward range over the members of a device information set, so callers can write
+    //
+    //     for (auto const & devInfoData : device_info_range(devs.get())) { ... }
+    //
+    // instead of counting indices up to ERROR_NO_MORE_ITEMS. Members are enumerated batchSize at
+    // a time, and the registry properties listed in 'properties' are read for the whole batch as
+    // it is fetched; iterator::property() then serves them without going back to SetupAPI.
+    //
+    // An enumeration failure other than ERROR_NO_MORE_ITEMS ends the range early and is
+    // reported by error(). The range must outlive its iterators.
+    class device_info_range
+    {
+        struct batch
+        {
+            DWORD first = 0;
+            std::vector<SP_DEVINFO_DATA> devices;
+            std::vector<details::property_slot> slots;
+            std::vector<BYTE> arena;
+        };
+
+        HDEVINFO m_deviceInfoSet;
+        DWORD m_batchSize;
+        std::vector<DWORD> m_properties;
+        mutable win32_err m_error;
+
+        void fill(batch & b, DWORD first) const
+        {
+            b.first = first;
+            b.devices.clear();
+            b.slots.clear();
+            b.arena.clear();
+
+            for (DWORD i = 0; i < m_batchSize; i++)
+            {
+                SP_DEVINFO_DATA devInfoData = { sizeof(SP_DEVINFO_DATA) };
+                if (!SetupDiEnumDeviceInfo(m_deviceInfoSet, first + i, &devInfoData))
+                {
+                    auto err = GetLastError();
+                    if (err != ERROR_NO_MORE_ITEMS) m_error = err;
+                    break;
+                }
+
+                b.devices.push_back(devInfoData);
+
+                for (auto property : m_properties)
+                {
+                    b.slots.push_back(details::append_registry_property(m_deviceInfoSet, b.devices.back(), property, b.arena));
+                }
+            }
+        }
+
+    public:
+        class iterator : public std::iterator<std::forward_iterator_tag, SP_DEVINFO_DATA, ptrdiff_t, SP_DEVINFO_DATA const *, SP_DEVINFO_DATA const &>
+        {
+            friend class device_info_range;
+
+            device_info_range const * m_range = nullptr;
+            std::shared_ptr<batch> m_batch;
+            size_t m_position = 0;
+
+            iterator(device_info_range const * range, std::shared_ptr<batch>&& b) : m_range(range), m_batch(std::move(b))
+            {
+                if (m_batch->devices.empty()) m_batch.reset();
+            }
+
+            DWORD index() const
+            {
+                return m_batch ? m_batch->first + static_cast<DWORD>(m_position) : MAXDWORD;
+            }
+
+        public:
+            iterator() { }
+
+            bool operator==(iterator const & other) const
+            {
+                return index() == other.index();
+            }
+
+            bool operator!=(iterator const & other) const
+            {
+                return !(*this == other);
+            }
+
+            reference operator*() const
+            {
+                return m_batch->devices[m_position];
+            }
+
+            pointer operator->() const
+            {
+                return &m_batch->devices[m_position];
+            }
+
+            iterator & operator++()
+            {
+                if (++m_position < m_batch->devices.size()) return *this;
+
+                // a short batch means enumeration already ran out
+                if (m_batch->devices.size() < m_range->m_batchSize)
+                {
+                    m_batch.reset();
+                    return *this;
+                }
+
+                auto next = m_batch->first + static_cast<DWORD>(m_batch->devices.size());
+
+                // copies of this iterator still look at the old batch; only reuse it if none do
+                if (m_batch.use_count() != 1) m_batch = std::make_shared<batch>();
+
+                m_range->fill(*m_batch, next);
+                m_position = 0;
+
+                if (m_batch->devices.empty()) m_batch.reset();
+
+                return *this;
+            }
+
+            iterator operator++(int)
+            {
+                auto prev = *this;
+                ++(*this);
+                return prev;
+            }
+
+            // Position of the current device in the set, as passed to SetupDiEnumDeviceInfo.
+            DWORD member_index() const
+            {
+                return index();
+            }
+
+            // A property requested when the range was created. ERROR_NOT_FOUND if it was not
+            // requested; otherwise the error SetupAPI gave for this device, if any.
+            win32_err_t<device_property> property(DWORD property) const
+            {
+                auto const & properties = m_range->m_properties;
+                auto found = std::find(properties.begin(), properties.end(), property);
+                if (found == properties.end()) return ERROR_NOT_FOUND;
+
+                auto const & slot = m_batch->slots[m_position * properties.size() + (found - properties.begin())];
+                if (slot.error != ERROR_SUCCESS) return slot.error;
+
+                device_property value = { slot.type, m_batch->arena.data() + slot.offset, slot.size };
+                return win32_err_t<device_property>::success(value);
+            }
+        };
+
+        using const_iterator = iterator;
+
+        explicit device_info_range(HDEVINFO deviceInfoSet, DWORD batchSize = 1, std::vector<DWORD> properties = std::vector<DWORD>()) :
+            m_deviceInfoSet(deviceInfoSet),
+            m_batchSize(batchSize ? batchSize : 1),
+            m_properties(std::move(properties))
+        {
+
+        }
+
+        iterator begin() const
+        {
+            auto first = std::make_shared<batch>();
+            fill(*first, 0);
+
+            return iterator(this, std::move(first));
+        }
+
+        iterator end() const
+        {
+            return iterator();
+        }
+
+        // The first enumeration failure seen by any iterator, other than ERROR_NO_MORE_ITEMS.
+        win32_err error() const
+        {
+            return m_error;
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <Windows.h>
+#include <cfgmgr32.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cfgmgr.h"
+#include "multi_sz.h"
+#include "resource_handle.h"
+#include "result.h"
+
+namespace wtl
+{
+    namespace details
+    {
+        struct guid_less
+        {
+            bool operator()(GUID const & a, GUID const & b) const
+            {
+                return std::memcmp(&a, &b, sizeof(GUID)) < 0;
+            }
+        };
+    }
+
+    // Backend for basic_device_interface_cache that talks to the config manager. Listeners are
+    // told about interface arrival and removal through CM_Register_Notification.
+    struct cm_interface_backend
+    {
+        using registration = hcmnotification;
+
+        configret_t<multi_sz> get_device_interface_list(GUID const & classGuid)
+        {
+            return cm::get_device_interface_list(classGuid, nullptr, CM_GET_DEVICE_INTERFACE_LIST_PRESENT);
+        }
+
+        template<typename Listener>
+        configret_t<registration> register_notification(GUID const & classGuid, Listener * listener)
+        {
+            return cm::register_interface_notification(classGuid, on_notification<Listener>, listener);
+        }
+
+    private:
+        template<typename Listener>
+        static DWORD CALLBACK on_notification(HCMNOTIFICATION, PVOID context, CM_NOTIFY_ACTION action, PCM_NOTIFY_EVENT_DATA, DWORD)
+        {
+            if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL || action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL)
+            {
+                static_cast<Listener *>(context)->invalidate();
+            }
+
+            return ERROR_SUCCESS;
+        }
+    };
+
+    namespace details
+    {
+        struct fake_cfgmgr_state
+        {
+            std::mutex lock;
+            std::mutex dispatchLock;
+            std::map<GUID, std::vector<std::wstring>, guid_less> interfaces;
+            std::map<std::uint64_t, std::pair<GUID, std::function<void()>>> listeners;
+            std::uint64_t nextListener = 1;
+            size_t listCalls = 0;
+            std::chrono::microseconds latency{ 0 };
+        };
+    }
+
+    // In-process stand-in for the config manager with the same backend surface as
+    // cm_interface_backend. Copies share one device table. add_interface and remove_interface
+    // notify listeners synchronously on the calling thread; as with CM_Unregister_Notification,
+    // a registration must not be closed from inside its own callback.
+    class fake_cfgmgr
+    {
+        std::shared_ptr<details::fake_cfgmgr_state> m_state;
+
+        void notify(GUID const & classGuid)
+        {
+            std::lock_guard<std::mutex> dispatch(m_state->dispatchLock);
+
+            std::vector<std::function<void()>> targets;
+            {
+                std::lock_guard<std::mutex> guard(m_state->lock);
+                for (auto & listener : m_state->listeners)
+                {
+                    if (IsEqualGUID(listener.second.first, classGuid))
+                    {
+                        targets.push_back(listener.second.second);
+                    }
+                }
+            }
+
+            for (auto & target : targets)
+            {
+                target();
+            }
+        }
+
+    public:
+        class registration
+        {
+            std::shared_ptr<details::fake_cfgmgr_state> m_state;
+            std::uint64_t m_id = 0;
+
+        public:
+            registration() { }
+
+            registration(std::shared_ptr<details::fake_cfgmgr_state> s, std::uint64_t id) : m_state(std::move(s)), m_id(id) { }
+
+            registration(registration&& other) : m_state(std::move(other.m_state)), m_id(other.m_id) { }
+
+            registration & operator=(registration&& other)
+            {
+                reset();
+                m_state = std::move(other.m_state);
+                m_id = other.m_id;
+
+                return *this;
+            }
+
+            ~registration()
+            {
+                reset();
+            }
+
+            operator bool() const { return m_state != nullptr; }
+
+            // Waits for a notification in progress, like CM_Unregister_Notification.
+            void reset()
+            {
+                if (m_state)
+                {
+                    std::lock_guard<std::mutex> dispatch(m_state->dispatchLock);
+                    std::lock_guard<std::mutex> guard(m_state->lock);
+                    m_state->listeners.erase(m_id);
+                    m_state.reset();
+                }
+            }
+        };
+
+        fake_cfgmgr() : m_state(std::make_shared<details::fake_cfgmgr_state>()) { }
+
+        void add_interface(GUID const & classGuid, std::wstring path)
+        {
+            {
+                std::lock_guard<std::mutex> guard(m_state->lock);
+                m_state->interfaces[classGuid].push_back(std::move(path));
+            }
+
+            notify(classGuid);
+        }
+
+        bool remove_interface(GUID const & classGuid, std::wstring const & path)
+        {
+            {
+                std::lock_guard<std::mutex> guard(m_state->lock);
+
+                auto & paths = m_state->interfaces[classGuid];
+                auto found = std::find(paths.begin(), paths.end(), path);
+                if (found == paths.end()) return false;
+
+                paths.erase(found);
+            }
+
+            notify(classGuid);
+            return true;
+        }
+
+        // Number of list fetches served so far, for checking cache hit rates.
+        size_t list_calls() const
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            return m_state->listCalls;
+        }
+
+        // Makes every list fetch take at least this long, to stand in for a slow config manager.
+        void set_latency(std::chrono::microseconds latency)
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            m_state->latency = latency;
+        }
+
+        configret_t<multi_sz> get_device_interface_list(GUID const & classGuid)
+        {
+            std::vector<wchar_t> buffer;
+            std::chrono::microseconds latency;
+            {
+                std::lock_guard<std::mutex> guard(m_state->lock);
+                m_state->listCalls++;
+                latency = m_state->latency;
+
+                auto found = m_state->interfaces.find(classGuid);
+                if (found != m_state->interfaces.end())
+                {
+                    for (auto const & path : found->second)
+                    {
+                        buffer.insert(buffer.end(), path.begin(), path.end());
+                        buffer.push_back(L'\0');
+                    }
+                }
+            }
+
+            buffer.push_back(L'\0');
+
+            if (latency.count() > 0)
+            {
+                std::this_thread::sleep_for(latency);
+            }
+
+            return configret_t<multi_sz>::success(multi_sz(std::move(buffer)));
+        }
+
+        template<typename Listener>
+        configret_t<registration> register_notification(GUID const & classGuid, Listener * listener)
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+
+            auto id = m_state->nextListener++;
+            m_state->listeners.emplace(id, std::make_pair(classGuid, std::function<void()>([listener] { listener->invalidate(); })));
+
+            return configret_t<registration>::success(registration(m_state, id));
+        }
+    };
+
+    // Device interface lists keyed by class GUID. Each class is fetched once and then served as
+    // a shared, immutable snapshot until the backend reports an interface arrival or removal for
+    // that class; only then is the next get() a round trip. Snapshots already handed out stay
+    // valid after invalidation.
+    //
+    // Thread safe. Concurrent misses on one class may each fetch the list; whichever finishes
+    // is cached unless a notification arrived in the meantime.
+    template<typename Backend>
+    class basic_device_interface_cache
+    {
+    public:
+        using snapshot_type = std::shared_ptr<multi_sz const>;
+
+    private:
+        struct state;
+
+        struct entry
+        {
+            state * owner;
+            std::uint64_t generation = 0;
+            snapshot_type snapshot;
+            typename Backend::registration subscription;
+
+            explicit entry(state * owner) : owner(owner) { }
+
+            // called from the backend's notification thread
+            void invalidate()
+            {
+                std::lock_guard<std::mutex> guard(owner->lock);
+                generation++;
+                snapshot.reset();
+            }
+        };
+
+        struct state
+        {
+            Backend backend;
+            std::mutex lock;
+            std::mutex subscribeLock;
+
+            // destroyed first, so subscriptions are closed while the locks are still alive
+            std::map<GUID, std::unique_ptr<entry>, details::guid_less> entries;
+
+            explicit state(Backend&& backend) : backend(std::move(backend)) { }
+        };
+
+        std::unique_ptr<state> m_state;
+
+        explicit basic_device_interface_cache(std::unique_ptr<state>&& s) : m_state(std::move(s)) { }
+
+    public:
+        basic_device_interface_cache(basic_device_interface_cache&& other) = default;
+        basic_device_interface_cache & operator=(basic_device_interface_cache&& other) = default;
+
+        static configret_t<basic_device_interface_cache> create(Backend backend = Backend())
+        {
+            std::unique_ptr<state> s(new (std::nothrow) state(std::move(backend)));
+            if (!s) return CR_OUT_OF_MEMORY;
+
+            return configret_t<basic_device_interface_cache>::success(basic_device_interface_cache(std::move(s)));
+        }
+
+        configret_t<snapshot_type> get(GUID const & classGuid)
+        {
+            entry * e;
+            std::uint64_t generation;
+            {
+                std::lock_guard<std::mutex> guard(m_state->lock);
+
+                auto & slot = m_state->entries[classGuid];
+                if (!slot)
+                {
+                    slot.reset(new (std::nothrow) entry(m_state.get()));
+                    if (!slot) return CR_OUT_OF_MEMORY;
+                }
+
+                e = slot.get();
+                if (e->snapshot) return configret_t<snapshot_type>::success(e->snapshot);
+
+                generation = e->generation;
+            }
+
+            // subscribe before fetching so a change racing with the fetch invalidates it
+            {
+                std::lock_guard<std::mutex> guard(m_state->subscribeLock);
+                if (!e->subscription)
+                {
+                    RETURN_OR_UNWRAP(subscription, m_state->backend.register_notification(classGuid, e));
+                    e->subscription = std::move(subscription);
+                }
+            }
+
+            RETURN_OR_UNWRAP(list, m_state->backend.get_device_interface_list(classGuid));
+            snapshot_type snapshot = std::make_shared<multi_sz>(std::move(list));
+
+            {
+                std::lock_guard<std::mutex> guard(m_state->lock);
+                if (e->generation == generation)
+                {
+                    e->snapshot = snapshot;
+                }
+            }
+
+            return configret_t<snapshot_type>::success(std::move(snapshot));
+        }
+    };
+
+    using device_interface_cache = basic_device_interface_cache<cm_interface_backend>;
+}
\ No newline at end of file
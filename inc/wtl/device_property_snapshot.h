@@ -0,0 +1,147 @@
+#pragma once
+
+#include <Windows.h>
+#include <SetupAPI.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "device_info_range.h"
+#include "multi_sz.h"
+#include "result.h"
+#include "setup_di.h"
+
+namespace wtl
+{
+    // One column of a device_property_snapshot: a single property for every device, in device
+    // order, with all values packed next to each other in the snapshot's arena.
+    class device_property_column
+    {
+        std::vector<details::property_slot> const * m_slots;
+        std::vector<BYTE> const * m_arena;
+
+    public:
+        device_property_column(std::vector<details::property_slot> const & slots, std::vector<BYTE> const & arena) : m_slots(&slots), m_arena(&arena) { }
+
+        size_t size() const
+        {
+            return m_slots->size();
+        }
+
+        win32_err_t<device_property> get(size_t device) const
+        {
+            auto const & slot = (*m_slots)[device];
+            if (slot.error != ERROR_SUCCESS) return slot.error;
+
+            device_property value = { slot.type, m_arena->data() + slot.offset, slot.size };
+            return win32_err_t<device_property>::success(value);
+        }
+
+        // ERROR_INVALID_DATATYPE unless the value is REG_MULTI_SZ. The view stays valid for the
+        // lifetime of the snapshot.
+        win32_err_t<multi_sz_view> get_multi_sz(size_t device) const
+        {
+            auto const & slot = (*m_slots)[device];
+            if (slot.error != ERROR_SUCCESS) return slot.error;
+            if (slot.type != REG_MULTI_SZ) return ERROR_INVALID_DATATYPE;
+
+            return win32_err_t<multi_sz_view>::success(multi_sz_view(reinterpret_cast<wchar_t const *>(m_arena->data() + slot.offset)));
+        }
+    };
+
+    // A set of registry properties for every device in a device information set, fetched in one
+    // pass. Storage is struct-of-arrays: one slot table per property and a single arena holding
+    // every value, filled a column at a time, so queries over one property scan contiguous
+    // memory and the whole snapshot is a handful of allocations.
+    //
+    // Every value is followed by zero padding, so string and multi-string values that the
+    // registry stored without their terminators can still be read as such.
+    class device_property_snapshot
+    {
+        std::vector<DWORD> m_properties;
+        std::vector<SP_DEVINFO_DATA> m_devices;
+        std::vector<std::vector<details::property_slot>> m_columns;
+        std::vector<BYTE> m_arena;
+
+        device_property_snapshot() { }
+
+    public:
+        device_property_snapshot(device_property_snapshot&& other) = default;
+        device_property_snapshot & operator=(device_property_snapshot&& other) = default;
+
+        // The SP_DEVINFO_DATA entries refer to deviceInfoSet, which the caller keeps.
+        static win32_err_t<device_property_snapshot> create(HDEVINFO deviceInfoSet, std::vector<DWORD> properties)
+        {
+            device_property_snapshot snapshot;
+            snapshot.m_properties = std::move(properties);
+
+            // one pass; assign() would walk the forward range twice to size the vector first
+            device_info_range devices(deviceInfoSet);
+            for (auto const & devInfoData : devices)
+            {
+                snapshot.m_devices.push_back(devInfoData);
+            }
+
+            if (!devices.error()) return devices.error().get_result();
+
+            auto & arena = snapshot.m_arena;
+            snapshot.m_columns.resize(snapshot.m_properties.size());
+
+            for (size_t column = 0; column < snapshot.m_properties.size(); column++)
+            {
+                auto & slots = snapshot.m_columns[column];
+                slots.reserve(snapshot.m_devices.size());
+
+                for (auto & devInfoData : snapshot.m_devices)
+                {
+                    // keep values aligned for reading as wide strings or integers
+                    arena.resize((arena.size() + 7) & ~size_t(7));
+
+                    slots.push_back(details::append_registry_property(deviceInfoSet, devInfoData, snapshot.m_properties[column], arena));
+
+                    arena.insert(arena.end(), 2 * sizeof(wchar_t), 0);
+                }
+            }
+
+            return win32_err_t<device_property_snapshot>::success(std::move(snapshot));
+        }
+
+        static win32_err_t<device_property_snapshot> create(
+            GUID const & classGuid,
+            std::vector<DWORD> properties,
+            DWORD flags = DIGCF_PRESENT,
+            PCWSTR enumerator = nullptr,
+            PCWSTR machineName = nullptr)
+        {
+            RETURN_OR_UNWRAP(devs, setup_di::get_class_devs(classGuid, enumerator, nullptr, flags, machineName));
+
+            return create(devs.get(), std::move(properties));
+        }
+
+        size_t size() const
+        {
+            return m_devices.size();
+        }
+
+        // In device order. DevInst stays usable after the device information set is closed.
+        std::vector<SP_DEVINFO_DATA> const & devices() const
+        {
+            return m_devices;
+        }
+
+        std::vector<DWORD> const & properties() const
+        {
+            return m_properties;
+        }
+
+        // ERROR_NOT_FOUND if the property was not part of the snapshot.
+        win32_err_t<device_property_column> column(DWORD property) const
+        {
+            auto found = std::find(m_properties.begin(), m_properties.end(), property);
+            if (found == m_properties.end()) return ERROR_NOT_FOUND;
+
+            auto const & slots = m_columns[found - m_properties.begin()];
+            return win32_err_t<device_property_column>::success(device_property_column(slots, m_arena));
+        }
+    };
+}
\ No newline at end of file
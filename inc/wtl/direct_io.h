@@ -0,0 +1,330 @@
+#pragma once
+
+#include <windows.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "file.h"
+#include "result.h"
+
+namespace wtl
+{
+    namespace details
+    {
+        struct aligned_pool_state
+        {
+            std::uint8_t * region = nullptr;
+            DWORD bufferSize = 0;
+            DWORD alignment = 0;
+            std::mutex lock;
+            std::vector<DWORD> free;
+
+            ~aligned_pool_state()
+            {
+                if (region)
+                {
+                    ::VirtualFree(region, 0, MEM_RELEASE);
+                }
+            }
+        };
+
+        inline bool is_aligned(std::uint64_t value, DWORD alignment)
+        {
+            return value % alignment == 0;
+        }
+    }
+
+    class aligned_buffer_pool;
+
+    // A buffer checked out of an aligned_buffer_pool. Returns itself to the pool on destruction;
+    // the pool must outlive every buffer acquired from it.
+    class aligned_buffer
+    {
+        details::aligned_pool_state * m_pool = nullptr;
+        DWORD m_index = 0;
+
+        friend class aligned_buffer_pool;
+
+        aligned_buffer(details::aligned_pool_state * pool, DWORD index) : m_pool(pool), m_index(index) { }
+
+    public:
+        aligned_buffer() { }
+
+        aligned_buffer(aligned_buffer const & other) = delete;
+        aligned_buffer & operator=(aligned_buffer const & other) = delete;
+
+        aligned_buffer(aligned_buffer&& other) : m_pool(other.m_pool), m_index(other.m_index)
+        {
+            other.m_pool = nullptr;
+        }
+
+        aligned_buffer & operator=(aligned_buffer&& other)
+        {
+            reset();
+
+            m_pool = other.m_pool;
+            m_index = other.m_index;
+            other.m_pool = nullptr;
+
+            return *this;
+        }
+
+        ~aligned_buffer()
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            if (m_pool)
+            {
+                std::lock_guard<std::mutex> guard(m_pool->lock);
+                m_pool->free.push_back(m_index);
+                m_pool = nullptr;
+            }
+        }
+
+        operator bool() const { return m_pool != nullptr; }
+
+        std::uint8_t * data() const
+        {
+            return m_pool->region + static_cast<size_t>(m_index) * m_pool->bufferSize;
+        }
+
+        DWORD size() const
+        {
+            return m_pool->bufferSize;
+        }
+
+        std::uint8_t * begin() const { return data(); }
+
+        std::uint8_t * end() const { return data() + size(); }
+    };
+
+    // Fixed set of equally sized buffers carved out of a single VirtualAlloc region. Each buffer
+    // starts on a multiple of the requested alignment, which makes them suitable for
+    // FILE_FLAG_NO_BUFFERING reads and writes.
+    class aligned_buffer_pool
+    {
+        std::unique_ptr<details::aligned_pool_state> m_state;
+
+        explicit aligned_buffer_pool(std::unique_ptr<details::aligned_pool_state>&& state) : m_state(std::move(state)) { }
+
+    public:
+        aligned_buffer_pool(aligned_buffer_pool&& other) = default;
+        aligned_buffer_pool & operator=(aligned_buffer_pool&& other) = default;
+
+        static win32_err_t<aligned_buffer_pool> create(DWORD bufferSize, DWORD bufferCount, DWORD alignment)
+        {
+            if (bufferCount == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0) return ERROR_INVALID_PARAMETER;
+            if (bufferSize == 0 || !details::is_aligned(bufferSize, alignment)) return ERROR_INCORRECT_SIZE;
+
+            std::unique_ptr<details::aligned_pool_state> state(new (std::nothrow) details::aligned_pool_state());
+            if (!state) return ERROR_NOT_ENOUGH_MEMORY;
+
+            // VirtualAlloc returns allocation-granularity aligned memory, which covers any sector size.
+            SYSTEM_INFO systemInfo;
+            ::GetSystemInfo(&systemInfo);
+            if (alignment > systemInfo.dwAllocationGranularity) return ERROR_INVALID_PARAMETER;
+
+            auto total = static_cast<size_t>(bufferSize) * bufferCount;
+            state->region = static_cast<std::uint8_t *>(::VirtualAlloc(nullptr, total, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+            if (!state->region) return GetLastError();
+
+            state->bufferSize = bufferSize;
+            state->alignment = alignment;
+            state->free.reserve(bufferCount);
+            for (DWORD i = bufferCount; i > 0; i--)
+            {
+                state->free.push_back(i - 1);
+            }
+
+            return win32_err_t<aligned_buffer_pool>::success(aligned_buffer_pool(std::move(state)));
+        }
+
+        // Fails with ERROR_NO_SYSTEM_RESOURCES when every buffer is checked out.
+        win32_err_t<aligned_buffer> acquire()
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            if (m_state->free.empty()) return ERROR_NO_SYSTEM_RESOURCES;
+
+            auto index = m_state->free.back();
+            m_state->free.pop_back();
+
+            return win32_err_t<aligned_buffer>::success(aligned_buffer(m_state.get(), index));
+        }
+
+        DWORD buffer_size() const
+        {
+            return m_state->bufferSize;
+        }
+
+        DWORD alignment() const
+        {
+            return m_state->alignment;
+        }
+    };
+
+    // A file opened with FILE_FLAG_NO_BUFFERING. Reads and writes check sector alignment up front
+    // and fail with a specific error instead of the generic ERROR_INVALID_PARAMETER the kernel
+    // returns:
+    //   misaligned offset         ERROR_OFFSET_ALIGNMENT_VIOLATION
+    //   misaligned length         ERROR_INCORRECT_SIZE
+    //   misaligned buffer address ERROR_INVALID_USER_BUFFER
+    class direct_file : public file
+    {
+        DWORD m_sectorSize = 0;
+        DWORD m_recommendedAlignment = 0;
+        bool m_overlapped = false;
+
+        direct_file(file&& f, DWORD sectorSize, DWORD recommendedAlignment, bool isOverlapped) :
+            file(std::move(f)),
+            m_sectorSize(sectorSize),
+            m_recommendedAlignment(recommendedAlignment),
+            m_overlapped(isOverlapped)
+        {
+        }
+
+        // A synchronous transfer at 'offset'. On a handle opened with FILE_FLAG_OVERLAPPED the
+        // request can still pend, so it gets its own event and is waited for before the
+        // OVERLAPPED on this stack frame goes away.
+        template<typename Transfer>
+        win32_err transfer_at(std::uint64_t offset, DWORD * transferred, Transfer&& transfer)
+        {
+            DWORD ignored;
+            if (!transferred) transferred = &ignored;
+
+            event done;
+            if (m_overlapped)
+            {
+                RETURN_OR_UNWRAP(e, event::create(false, true));
+                done = std::move(e);
+            }
+
+            // the low bit keeps a completion port the handle is bound to from queuing a packet
+            // for this request
+            auto positioned = overlapped::at(offset, done ? reinterpret_cast<HANDLE>(reinterpret_cast<ULONG_PTR>(done.get()) | 1) : NULL);
+
+            if (transfer(transferred, positioned.get())) return ERROR_SUCCESS;
+
+            auto err = GetLastError();
+            if (err != ERROR_IO_PENDING) return err;
+
+            if (!::GetOverlappedResult(get(), positioned.get(), transferred, TRUE)) return GetLastError();
+
+            return ERROR_SUCCESS;
+        }
+
+        static bool offset_matches(std::uint64_t offset, LPOVERLAPPED ol)
+        {
+            return !ol || offset == ((static_cast<std::uint64_t>(ol->OffsetHigh) << 32) | ol->Offset);
+        }
+
+    public:
+        direct_file() : file() { }
+
+        static win32_err_t<direct_file> create(
+            _In_     PCWSTR fileName,
+                     DWORD desiredAccess,
+                     DWORD shareMode = 0,
+            _In_opt_ LPSECURITY_ATTRIBUTES securityAttributes = nullptr,
+                     DWORD creationDisposition = OPEN_EXISTING,
+                     DWORD flagsAndAttributes = FILE_ATTRIBUTE_NORMAL)
+        {
+            RETURN_OR_UNWRAP(f, file::create(
+                fileName,
+                desiredAccess,
+                shareMode,
+                securityAttributes,
+                creationDisposition,
+                flagsAndAttributes | FILE_FLAG_NO_BUFFERING));
+
+            RETURN_OR_UNWRAP(storageInfo, f.get_storage_info());
+
+            auto sectorSize = storageInfo.LogicalBytesPerSector;
+            auto recommendedAlignment = std::max(sectorSize, storageInfo.PhysicalBytesPerSectorForPerformance);
+            auto isOverlapped = (flagsAndAttributes & FILE_FLAG_OVERLAPPED) != 0;
+
+            return win32_err_t<direct_file>::success(direct_file(std::move(f), sectorSize, recommendedAlignment, isOverlapped));
+        }
+
+        // The logical sector size; every offset, length and buffer address must be a multiple.
+        DWORD sector_size() const
+        {
+            return m_sectorSize;
+        }
+
+        // The physical sector size. I/O aligned to it avoids read-modify-write cycles on drives
+        // that emulate smaller logical sectors, but is not required.
+        DWORD recommended_alignment() const
+        {
+            return m_recommendedAlignment;
+        }
+
+        win32_err validate(std::uint64_t offset, void const * buffer, DWORD length) const
+        {
+            if (!details::is_aligned(offset, m_sectorSize)) return ERROR_OFFSET_ALIGNMENT_VIOLATION;
+            if (!details::is_aligned(length, m_sectorSize)) return ERROR_INCORRECT_SIZE;
+            if (!details::is_aligned(reinterpret_cast<std::uintptr_t>(buffer), m_sectorSize)) return ERROR_INVALID_USER_BUFFER;
+
+            return ERROR_SUCCESS;
+        }
+
+        // When overlapped is null the read is synchronous at 'offset', even on an overlapped
+        // handle. Otherwise it is issued with the caller's OVERLAPPED, whose position has to be
+        // 'offset' (ERROR_INVALID_PARAMETER if not), and the caller completes it as usual.
+        win32_err read_at(std::uint64_t offset, void * buffer, DWORD length, _Out_opt_ DWORD * bytesRead = nullptr, _In_opt_ LPOVERLAPPED ol = nullptr)
+        {
+            if (!offset_matches(offset, ol)) return ERROR_INVALID_PARAMETER;
+
+            auto valid = validate(offset, buffer, length);
+            if (!valid) return valid;
+
+            if (ol)
+            {
+                if (!::ReadFile(get(), buffer, length, bytesRead, ol)) return GetLastError();
+
+                return ERROR_SUCCESS;
+            }
+
+            return transfer_at(offset, bytesRead, [&](DWORD * transferred, LPOVERLAPPED positioned)
+            {
+                return ::ReadFile(get(), buffer, length, transferred, positioned);
+            });
+        }
+
+        win32_err read_at(std::uint64_t offset, aligned_buffer const & buffer, _Out_opt_ DWORD * bytesRead = nullptr, _In_opt_ LPOVERLAPPED ol = nullptr)
+        {
+            return read_at(offset, buffer.data(), buffer.size(), bytesRead, ol);
+        }
+
+        // Same rules as read_at.
+        win32_err write_at(std::uint64_t offset, void const * buffer, DWORD length, _Out_opt_ DWORD * bytesWritten = nullptr, _In_opt_ LPOVERLAPPED ol = nullptr)
+        {
+            if (!offset_matches(offset, ol)) return ERROR_INVALID_PARAMETER;
+
+            auto valid = validate(offset, buffer, length);
+            if (!valid) return valid;
+
+            if (ol)
+            {
+                if (!::WriteFile(get(), buffer, length, bytesWritten, ol)) return GetLastError();
+
+                return ERROR_SUCCESS;
+            }
+
+            return transfer_at(offset, bytesWritten, [&](DWORD * transferred, LPOVERLAPPED positioned)
+            {
+                return ::WriteFile(get(), buffer, length, transferred, positioned);
+            });
+        }
+
+        win32_err write_at(std::uint64_t offset, aligned_buffer const & buffer, _Out_opt_ DWORD * bytesWritten = nullptr, _In_opt_ LPOVERLAPPED ol = nullptr)
+        {
+            return write_at(offset, buffer.data(), buffer.size(), bytesWritten, ol);
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,412 @@
+#pragma once
+
+#include <windows.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "resource_handle.h"
+#include "result.h"
+
+namespace wtl
+{
+    // One entry of a directory listing, viewed in place in the enumeration buffer. The name is
+    // not null terminated.
+    class directory_entry
+    {
+        void const * m_info = nullptr;
+        bool m_extended = false;
+
+        FILE_ID_EXTD_DIR_INFO const * extended() const
+        {
+            return static_cast<FILE_ID_EXTD_DIR_INFO const *>(m_info);
+        }
+
+        FILE_ID_BOTH_DIR_INFO const * both() const
+        {
+            return static_cast<FILE_ID_BOTH_DIR_INFO const *>(m_info);
+        }
+
+    public:
+        directory_entry() { }
+
+        directory_entry(void const * info, bool extended) : m_info(info), m_extended(extended) { }
+
+        wchar_t const * name_data() const
+        {
+            return m_extended ? extended()->FileName : both()->FileName;
+        }
+
+        size_t name_length() const
+        {
+            return (m_extended ? extended()->FileNameLength : both()->FileNameLength) / sizeof(wchar_t);
+        }
+
+        std::wstring name() const
+        {
+            return std::wstring(name_data(), name_length());
+        }
+
+        DWORD attributes() const
+        {
+            return m_extended ? extended()->FileAttributes : both()->FileAttributes;
+        }
+
+        bool is_directory() const
+        {
+            return (attributes() & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        }
+
+        bool is_reparse_point() const
+        {
+            return (attributes() & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+        }
+
+        // "." or ".."
+        bool is_dot() const
+        {
+            auto length = name_length();
+            auto name = name_data();
+
+            return (length == 1 && name[0] == L'.') || (length == 2 && name[0] == L'.' && name[1] == L'.');
+        }
+
+        // Zero unless the entry is a reparse point.
+        DWORD reparse_tag() const
+        {
+            if (!is_reparse_point()) return 0;
+
+            // FILE_ID_BOTH_DIR_INFO reports the tag in place of the EA size
+            return m_extended ? extended()->ReparsePointTag : both()->EaSize;
+        }
+
+        std::uint64_t size() const
+        {
+            return static_cast<std::uint64_t>(m_extended ? extended()->EndOfFile.QuadPart : both()->EndOfFile.QuadPart);
+        }
+
+        std::uint64_t allocation_size() const
+        {
+            return static_cast<std::uint64_t>(m_extended ? extended()->AllocationSize.QuadPart : both()->AllocationSize.QuadPart);
+        }
+
+        LARGE_INTEGER creation_time() const
+        {
+            return m_extended ? extended()->CreationTime : both()->CreationTime;
+        }
+
+        LARGE_INTEGER last_write_time() const
+        {
+            return m_extended ? extended()->LastWriteTime : both()->LastWriteTime;
+        }
+
+        // 128-bit on file systems that report FileIdExtdDirectoryInfo, the 64-bit file ID
+        // widened otherwise.
+        FILE_ID_128 file_id() const
+        {
+            if (m_extended) return extended()->FileId;
+
+            FILE_ID_128 id = {};
+            std::memcpy(id.Identifier, &both()->FileId, sizeof(both()->FileId));
+            return id;
+        }
+    };
+
+    // Single pass range over the entries of a directory, read with GetFileInformationByHandleEx
+    // into one reusable buffer. Each call returns as many entries as fit, so a large buffer lists
+    // big directories in few round trips and no entry is allocated or copied:
+    //
+    //     for (auto const & entry : range.get()) { ... }
+    //
+    // Entries are views into the buffer and stay valid until the iterator moves past the batch
+    // they came in. "." and ".." are skipped. Uses FileIdExtdDirectoryInfo and falls back to
+    // FileIdBothDirectoryInfo on file systems that do not support it. A failure other than
+    // running out of entries ends the range early and is reported by error().
+    class directory_range
+    {
+        handle m_directory;
+        std::vector<std::uint64_t> m_buffer;
+        FILE_INFO_BY_HANDLE_CLASS m_infoClass = FileIdExtdDirectoryInfo;
+        win32_err m_error;
+        bool m_started = false;
+
+        // Reads the next batch. False once the directory is exhausted or on failure.
+        bool fill()
+        {
+            for (;;)
+            {
+                if (::GetFileInformationByHandleEx(m_directory.get(), m_infoClass, m_buffer.data(), static_cast<DWORD>(m_buffer.size() * sizeof(m_buffer[0]))))
+                {
+                    return true;
+                }
+
+                auto err = GetLastError();
+                if (m_infoClass == FileIdExtdDirectoryInfo && (err == ERROR_INVALID_PARAMETER || err == ERROR_NOT_SUPPORTED))
+                {
+                    m_infoClass = FileIdBothDirectoryInfo;
+                    continue;
+                }
+
+                if (err != ERROR_NO_MORE_FILES) m_error = err;
+                return false;
+            }
+        }
+
+        std::uint8_t const * buffer() const
+        {
+            return reinterpret_cast<std::uint8_t const *>(m_buffer.data());
+        }
+
+        static ULONG next_offset(std::uint8_t const * info)
+        {
+            // NextEntryOffset is the first field of both layouts
+            ULONG next;
+            std::memcpy(&next, info, sizeof(next));
+            return next;
+        }
+
+    public:
+        class iterator : public std::iterator<std::input_iterator_tag, directory_entry, ptrdiff_t, directory_entry const *, directory_entry const &>
+        {
+            friend class directory_range;
+
+            directory_range * m_range = nullptr;
+            std::uint8_t const * m_info = nullptr;
+            directory_entry m_entry;
+
+            iterator(directory_range * range) : m_range(range)
+            {
+                if (!m_range->fill())
+                {
+                    m_range = nullptr;
+                    return;
+                }
+
+                settle(m_range->buffer());
+            }
+
+            // Points at 'info', or the first entry after it that is not "." or "..".
+            void settle(std::uint8_t const * info)
+            {
+                for (;;)
+                {
+                    m_info = info;
+                    m_entry = directory_entry(info, m_range->m_infoClass == FileIdExtdDirectoryInfo);
+                    if (!m_entry.is_dot()) return;
+
+                    if (!advance()) return;
+                    info = m_info;
+                }
+            }
+
+            // Moves m_info to the next entry, refilling the buffer when the batch is used up.
+            bool advance()
+            {
+                auto next = next_offset(m_info);
+                if (next != 0)
+                {
+                    m_info += next;
+                    return true;
+                }
+
+                if (!m_range->fill())
+                {
+                    m_range = nullptr;
+                    m_info = nullptr;
+                    return false;
+                }
+
+                m_info = m_range->buffer();
+                return true;
+            }
+
+        public:
+            iterator() { }
+
+            bool operator==(iterator const & other) const
+            {
+                return m_info == other.m_info;
+            }
+
+            bool operator!=(iterator const & other) const
+            {
+                return !(*this == other);
+            }
+
+            reference operator*() const
+            {
+                return m_entry;
+            }
+
+            pointer operator->() const
+            {
+                return &m_entry;
+            }
+
+            iterator & operator++()
+            {
+                if (advance()) settle(m_info);
+
+                return *this;
+            }
+        };
+
+        directory_range() { }
+
+        directory_range(directory_range&& other) = default;
+        directory_range & operator=(directory_range&& other) = default;
+
+        // bufferSize is rounded up to a multiple of 8 bytes.
+        static win32_err_t<directory_range> open(PCWSTR path, DWORD bufferSize = 64 * 1024)
+        {
+            directory_range range;
+
+            range.m_directory = handle(::CreateFileW(
+                path,
+                FILE_LIST_DIRECTORY | SYNCHRONIZE,
+                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                nullptr,
+                OPEN_EXISTING,
+                FILE_FLAG_BACKUP_SEMANTICS,
+                nullptr));
+
+            if (!range.m_directory) return GetLastError();
+
+            range.m_buffer.resize((std::max<DWORD>(bufferSize, 4096) + 7) / sizeof(std::uint64_t));
+
+            return win32_err_t<directory_range>::success(std::move(range));
+        }
+
+        // Can only be called once; the directory handle is read sequentially.
+        iterator begin()
+        {
+            if (m_started) return end();
+            m_started = true;
+
+            return iterator(this);
+        }
+
+        iterator end()
+        {
+            return iterator();
+        }
+
+        win32_err error() const
+        {
+            return m_error;
+        }
+    };
+
+    struct walk_options
+    {
+        // 0 uses std::thread::hardware_concurrency(). 1 walks on the calling thread only.
+        unsigned thread_count = 0;
+
+        // Enumeration buffer per directory; rounded up to a multiple of 8 bytes.
+        DWORD buffer_size = 64 * 1024;
+
+        // Otherwise directories that cannot be read are skipped and the first such error is
+        // returned once the rest of the tree has been walked.
+        bool stop_on_error = false;
+    };
+
+    // Walks the tree below 'root', calling callback(std::wstring const & directory,
+    // directory_entry const & entry) for every entry. Directories are handed out to worker
+    // threads, the calling thread included, so with more than one thread the callback runs
+    // concurrently and in no particular order. Reparse points are reported but not followed.
+    template<typename Callback>
+    win32_err walk_directory_tree(PCWSTR root, Callback&& callback, walk_options const & options = walk_options())
+    {
+        std::mutex lock;
+        std::condition_variable changed;
+        std::deque<std::wstring> pending(1, root);
+        unsigned busy = 0;
+        DWORD firstError = ERROR_SUCCESS;
+        bool stopping = false;
+
+        auto fail = [&](DWORD err)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (firstError == ERROR_SUCCESS) firstError = err;
+            if (options.stop_on_error) stopping = true;
+        };
+
+        auto run = [&]
+        {
+            std::vector<std::wstring> subdirectories;
+
+            for (;;)
+            {
+                std::wstring directory;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&] { return stopping || !pending.empty() || busy == 0; });
+                    if (stopping || pending.empty()) break;
+
+                    directory = std::move(pending.front());
+                    pending.pop_front();
+                    busy++;
+                }
+
+                auto range = directory_range::open(directory.c_str(), options.buffer_size);
+                if (range)
+                {
+                    for (auto const & entry : range.get())
+                    {
+                        callback(static_cast<std::wstring const &>(directory), entry);
+
+                        if (entry.is_directory() && !entry.is_reparse_point())
+                        {
+                            subdirectories.emplace_back(directory);
+                            if (directory.back() != L'\\') subdirectories.back().push_back(L'\\');
+                            subdirectories.back().append(entry.name_data(), entry.name_length());
+                        }
+                    }
+
+                    if (!range.get().error()) fail(range.get().error().get_result());
+                }
+                else
+                {
+                    fail(range.get_result());
+                }
+
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    std::move(subdirectories.begin(), subdirectories.end(), std::back_inserter(pending));
+                    busy--;
+                }
+
+                subdirectories.clear();
+                changed.notify_all();
+            }
+
+            changed.notify_all();
+        };
+
+        unsigned threadCount = options.thread_count ? options.thread_count : std::max(1u, std::thread::hardware_concurrency());
+
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        for (unsigned i = 1; i < threadCount; i++)
+        {
+            threads.emplace_back(run);
+        }
+
+        run();
+
+        for (auto & t : threads)
+        {
+            t.join();
+        }
+
+        return firstError;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,366 @@
+#pragma once
+
+#include <windows.h>
+#include <threadpoolapiset.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "event.h"
+#include "primitives.h"
+#include "resource_handle.h"
+#include "result.h"
+
+namespace wtl
+{
+    struct file_change
+    {
+        // Changes were dropped because the notification buffer overflowed; rescan 'path', which
+        // is the watched directory.
+        static const DWORD overflowed = 0x80000000;
+
+        // The watch failed and was stopped, typically because the watched directory, 'path',
+        // was deleted.
+        static const DWORD stopped = 0x40000000;
+
+        std::wstring path;
+
+        // (1 << FILE_ACTION_*) for every action seen on the path, plus the flags above.
+        DWORD actions;
+
+        bool has(DWORD fileAction) const
+        {
+            return (actions & (1u << fileAction)) != 0;
+        }
+    };
+
+    struct watch_options
+    {
+        DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+
+        bool recursive = false;
+
+        // Per directory. Network shares fail reads larger than 64KiB.
+        DWORD buffer_size = 64 * 1024;
+    };
+
+    // Watches any number of directories with overlapped ReadDirectoryChangesW. Completions run on
+    // the thread pool, so no thread is dedicated to watching and thousands of directories cost
+    // only their buffers.
+    //
+    // Changes are coalesced: the first change after a delivery opens a window, and everything
+    // that happens to a path until the window closes is merged into one file_change. The change
+    // set is then ready, and is handed out by wait(), or by take() once ready_handle() is
+    // signaled. add, remove, take and wait must be called from one thread at a time.
+    class directory_watcher
+    {
+        struct state;
+
+        struct watch
+        {
+            state * owner;
+            std::wstring path;
+            handle directory;
+            PTP_IO io = nullptr;
+            OVERLAPPED ol = {};
+            std::vector<DWORD> buffer;
+            watch_options options;
+
+            // serializes re-issuing the read with remove() cancelling it
+            std::mutex lock;
+            bool closing = false;
+        };
+
+        struct state
+        {
+            event ready;
+            PTP_TIMER timer = nullptr;
+            dword_milliseconds window;
+
+            std::mutex lock;
+            std::vector<file_change> changes;
+            std::unordered_map<std::wstring, size_t> index;
+            bool windowOpen = false;
+
+            std::unordered_map<std::wstring, std::unique_ptr<watch>> watches;
+
+            ~state()
+            {
+                for (auto & entry : watches)
+                {
+                    close(*entry.second);
+                }
+
+                if (timer)
+                {
+                    ::SetThreadpoolTimer(timer, nullptr, 0, 0);
+                    ::WaitForThreadpoolTimerCallbacks(timer, TRUE);
+                    ::CloseThreadpoolTimer(timer);
+                }
+            }
+
+            static void close(watch & w)
+            {
+                {
+                    std::lock_guard<std::mutex> guard(w.lock);
+                    w.closing = true;
+                    ::CancelIoEx(w.directory.get(), &w.ol);
+                }
+
+                ::WaitForThreadpoolIoCallbacks(w.io, FALSE);
+                ::CloseThreadpoolIo(w.io);
+            }
+
+            // Caller holds 'lock'.
+            void record(std::wstring&& path, DWORD actions)
+            {
+                auto found = index.find(path);
+                if (found != index.end())
+                {
+                    changes[found->second].actions |= actions;
+                    return;
+                }
+
+                index.emplace(path, changes.size());
+                file_change change = { std::move(path), actions };
+                changes.push_back(std::move(change));
+            }
+
+            // Caller holds 'lock'.
+            void open_window()
+            {
+                if (windowOpen) return;
+                windowOpen = true;
+
+                if (window.count() == 0)
+                {
+                    ready.set();
+                    return;
+                }
+
+                // relative due time in 100ns units
+                LARGE_INTEGER due;
+                due.QuadPart = -static_cast<LONGLONG>(window.count()) * 10000;
+
+                FILETIME dueTime;
+                dueTime.dwLowDateTime = due.LowPart;
+                dueTime.dwHighDateTime = static_cast<DWORD>(due.HighPart);
+                ::SetThreadpoolTimer(timer, &dueTime, 0, 0);
+            }
+        };
+
+        std::unique_ptr<state> m_state;
+
+        explicit directory_watcher(std::unique_ptr<state>&& s) : m_state(std::move(s)) { }
+
+        static DWORD issue(watch & w)
+        {
+            ::StartThreadpoolIo(w.io);
+
+            if (!::ReadDirectoryChangesW(w.directory.get(), w.buffer.data(), static_cast<DWORD>(w.buffer.size() * sizeof(DWORD)), w.options.recursive, w.options.filter, nullptr, &w.ol, nullptr))
+            {
+                auto err = GetLastError();
+                ::CancelThreadpoolIo(w.io);
+
+                return err;
+            }
+
+            return ERROR_SUCCESS;
+        }
+
+        static void CALLBACK on_timer(PTP_CALLBACK_INSTANCE, PVOID context, PTP_TIMER)
+        {
+            auto owner = static_cast<state *>(context);
+
+            std::lock_guard<std::mutex> guard(owner->lock);
+            owner->ready.set();
+        }
+
+        static void CALLBACK on_io(PTP_CALLBACK_INSTANCE, PVOID context, PVOID, ULONG result, ULONG_PTR bytesTransferred, PTP_IO)
+        {
+            auto w = static_cast<watch *>(context);
+            auto owner = w->owner;
+
+            if (result == ERROR_OPERATION_ABORTED) return;
+
+            {
+                std::lock_guard<std::mutex> guard(owner->lock);
+
+                if (result == ERROR_NOTIFY_ENUM_DIR || (result == ERROR_SUCCESS && bytesTransferred == 0))
+                {
+                    owner->record(std::wstring(w->path), file_change::overflowed);
+                }
+                else if (result != ERROR_SUCCESS)
+                {
+                    owner->record(std::wstring(w->path), file_change::stopped);
+                }
+                else
+                {
+                    auto data = reinterpret_cast<std::uint8_t const *>(w->buffer.data());
+                    for (;;)
+                    {
+                        auto info = reinterpret_cast<FILE_NOTIFY_INFORMATION const *>(data);
+
+                        std::wstring path = w->path;
+                        if (path.back() != L'\\') path.push_back(L'\\');
+                        path.append(info->FileName, info->FileNameLength / sizeof(wchar_t));
+
+                        auto action = info->Action < 31 ? 1u << info->Action : 0;
+                        owner->record(std::move(path), action);
+
+                        if (info->NextEntryOffset == 0) break;
+                        data += info->NextEntryOffset;
+                    }
+                }
+
+                owner->open_window();
+            }
+
+            if (result != ERROR_SUCCESS && result != ERROR_NOTIFY_ENUM_DIR) return;
+
+            std::lock_guard<std::mutex> guard(w->lock);
+            if (w->closing) return;
+
+            if (issue(*w) != ERROR_SUCCESS)
+            {
+                std::lock_guard<std::mutex> ownerGuard(owner->lock);
+                owner->record(std::wstring(w->path), file_change::stopped);
+                owner->open_window();
+            }
+        }
+
+    public:
+        directory_watcher(directory_watcher&& other) = default;
+        directory_watcher & operator=(directory_watcher&& other) = default;
+
+        static win32_err_t<directory_watcher> create(dword_milliseconds coalesceWindow = dword_milliseconds(50))
+        {
+            std::unique_ptr<state> s(new (std::nothrow) state());
+            if (!s) return ERROR_NOT_ENOUGH_MEMORY;
+
+            RETURN_OR_UNWRAP(ready, event::create(false, true));
+            s->ready = std::move(ready);
+            s->window = coalesceWindow;
+
+            s->timer = ::CreateThreadpoolTimer(on_timer, s.get(), nullptr);
+            if (!s->timer) return GetLastError();
+
+            return win32_err_t<directory_watcher>::success(directory_watcher(std::move(s)));
+        }
+
+        // Starts watching a directory. ERROR_ALREADY_EXISTS if the path is already watched.
+        win32_err add(PCWSTR path, watch_options const & options = watch_options())
+        {
+            if (m_state->watches.count(path)) return ERROR_ALREADY_EXISTS;
+
+            std::unique_ptr<watch> w(new (std::nothrow) watch());
+            if (!w) return ERROR_NOT_ENOUGH_MEMORY;
+
+            w->owner = m_state.get();
+            w->path = path;
+            w->options = options;
+            w->buffer.resize((options.buffer_size + sizeof(DWORD) - 1) / sizeof(DWORD));
+
+            w->directory = handle(::CreateFileW(
+                path,
+                FILE_LIST_DIRECTORY,
+                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                nullptr,
+                OPEN_EXISTING,
+                FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                nullptr));
+
+            if (!w->directory) return GetLastError();
+
+            w->io = ::CreateThreadpoolIo(w->directory.get(), on_io, w.get(), nullptr);
+            if (!w->io) return GetLastError();
+
+            auto err = issue(*w);
+            if (err != ERROR_SUCCESS)
+            {
+                ::CloseThreadpoolIo(w->io);
+                return err;
+            }
+
+            m_state->watches.emplace(w->path, std::move(w));
+
+            return ERROR_SUCCESS;
+        }
+
+        // Stops watching. Returns once no completion for the directory can still be running;
+        // changes already recorded for it are still delivered.
+        win32_err remove(PCWSTR path)
+        {
+            auto found = m_state->watches.find(path);
+            if (found == m_state->watches.end()) return ERROR_NOT_FOUND;
+
+            state::close(*found->second);
+            m_state->watches.erase(found);
+
+            return ERROR_SUCCESS;
+        }
+
+        size_t size() const
+        {
+            return m_state->watches.size();
+        }
+
+        // Manual reset event, signaled while a change set is ready. For waiting on the watcher
+        // alongside other handles; follow up with take().
+        HANDLE ready_handle() const
+        {
+            return m_state->ready.get();
+        }
+
+        // Replaces the contents of 'changes' with the ready change set, one entry per path in
+        // order of first change. Returns zero without blocking if none is ready.
+        size_t take(std::vector<file_change> & changes)
+        {
+            changes.clear();
+
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            if (::WaitForSingleObject(m_state->ready.get(), 0) != WAIT_OBJECT_0) return 0;
+
+            changes.swap(m_state->changes);
+            m_state->index.clear();
+            m_state->windowOpen = false;
+            m_state->ready.reset();
+
+            return changes.size();
+        }
+
+        // Blocks until a change set is ready and takes it. Returns zero if the timeout elapsed
+        // first.
+        win32_err_t<size_t> wait(std::vector<file_change> & changes, dword_milliseconds timeout = infinite)
+        {
+            auto until = timeout == infinite ? no_deadline : deadline_after(timeout);
+
+            for (;;)
+            {
+                auto taken = take(changes);
+                if (taken != 0) return win32_err_t<size_t>::success(taken);
+
+                RETURN_OR_UNWRAP(result, m_state->ready.wait(until));
+                if (result == wait_result::timeout) return win32_err_t<size_t>::success(take(changes));
+            }
+        }
+
+        // Calls callback(std::vector<file_change> const &) with the next change set.
+        template<typename Callback>
+        win32_err_t<size_t> wait(Callback&& callback, dword_milliseconds timeout = infinite)
+        {
+            std::vector<file_change> changes;
+
+            RETURN_OR_UNWRAP(taken, wait(changes, timeout));
+            if (taken != 0) callback(static_cast<std::vector<file_change> const &>(changes));
+
+            return win32_err_t<size_t>::success(taken);
+        }
+    };
+}
\ No newline at end of file
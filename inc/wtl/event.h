@@ -2,6 +2,9 @@
 
 #include <Synchapi.h>
 
+#include <algorithm>
+#include <chrono>
+
 #include "primitives.h"
 #include "resource_handle.h"
 
@@ -16,6 +19,79 @@ namespace wtl
         failed = WAIT_FAILED
     };
 
+    namespace details
+    {
+        using deadline_timer = resource_handle<HANDLE, int, NULL, decltype(::CloseHandle), ::CloseHandle>;
+
+        // One high resolution timer per thread, reused by every deadline wait on that thread.
+        inline HANDLE thread_deadline_timer()
+        {
+            thread_local deadline_timer timer;
+
+            if (!timer)
+            {
+                // CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, falling back to a regular timer before Windows 10 1803
+                timer = ::CreateWaitableTimerExW(nullptr, nullptr, 0x00000002, TIMER_ALL_ACCESS);
+                if (!timer) timer = ::CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+            }
+
+            return timer.get();
+        }
+
+        // WaitForMultipleObjectsEx against an absolute deadline. Non-alertable wait-any waits add
+        // the thread's waitable timer as the last handle, which gives sub-millisecond precision.
+        // Alertable waits do not use it, since an APC could start a deadline wait of its own on
+        // the same timer; they, wait-all waits and full handle arrays fall back to rounded-up
+        // millisecond timeouts. Returns the raw WAIT_* value, with the deadline passing reported
+        // as WAIT_TIMEOUT, and never returns WAIT_TIMEOUT before the deadline.
+        inline DWORD wait_until(DWORD count, HANDLE const * handles, bool waitAll, deadline until, bool alertable)
+        {
+            if (until == no_deadline)
+            {
+                return ::WaitForMultipleObjectsEx(count, handles, waitAll, INFINITE, alertable);
+            }
+
+            if (until <= std::chrono::steady_clock::now())
+            {
+                return ::WaitForMultipleObjectsEx(count, handles, waitAll, 0, alertable);
+            }
+
+            HANDLE timer = (waitAll || alertable || count >= MAXIMUM_WAIT_OBJECTS) ? NULL : thread_deadline_timer();
+
+            if (timer)
+            {
+                HANDLE withTimer[MAXIMUM_WAIT_OBJECTS];
+                std::copy(handles, handles + count, withTimer);
+                withTimer[count] = timer;
+
+                for (;;)
+                {
+                    auto now = std::chrono::steady_clock::now();
+                    if (now >= until) return WAIT_TIMEOUT;
+
+                    // relative due time in 100ns units, rounded up
+                    LARGE_INTEGER due;
+                    due.QuadPart = -static_cast<LONGLONG>((std::chrono::duration_cast<std::chrono::nanoseconds>(until - now).count() + 99) / 100);
+
+                    if (!::SetWaitableTimerEx(timer, &due, 0, nullptr, nullptr, nullptr, 0)) break;
+
+                    auto result = ::WaitForMultipleObjectsEx(count + 1, withTimer, FALSE, INFINITE, FALSE);
+                    ::CancelWaitableTimer(timer);
+
+                    // the timer and the steady clock can disagree slightly; go around with the
+                    // time that is left
+                    if (result != WAIT_OBJECT_0 + count) return result;
+                }
+            }
+
+            for (;;)
+            {
+                auto result = ::WaitForMultipleObjectsEx(count, handles, waitAll, remaining_milliseconds(until).count(), alertable);
+                if (result != WAIT_TIMEOUT || std::chrono::steady_clock::now() >= until) return result;
+            }
+        }
+    }
+
     class event : public resource_handle<HANDLE, int, NULL, decltype(::CloseHandle), ::CloseHandle>
     {
     public:
@@ -54,6 +130,17 @@ namespace wtl
 
             return win32_err_t<wait_result>::success(result);
         }
+
+        win32_err_t<wait_result> wait(
+            deadline until,
+            bool bAlertable = false)
+        {
+            HANDLE h = get();
+            auto result = static_cast<wait_result>(details::wait_until(1, &h, false, until, bAlertable));
+            if (result == wait_result::failed) return GetLastError();
+
+            return win32_err_t<wait_result>::success(result);
+        }
     };
 
     namespace details
@@ -81,6 +168,32 @@ namespace wtl
         return win32_err_t<HANDLE>::success(handles[result - WAIT_OBJECT_0]);
     }
 
+    template<typename... THandleArgs>
+    win32_err_t<HANDLE> wait_for_multiple_objects(
+        bool waitAll,
+        deadline until,
+        bool alertable,
+        THandleArgs const &... handleObjects)
+    {
+        HANDLE handles[] = { details::get(handleObjects)... };
+
+        const auto count = sizeof(handles) / sizeof(HANDLE);
+
+        auto result = details::wait_until(count, handles, waitAll, until, alertable);
+
+        if (result == WAIT_FAILED)
+            return GetLastError();
+
+        if (result >= WAIT_ABANDONED_0 && result < (WAIT_ABANDONED_0 + count))
+            return ERROR_ABANDONED_WAIT_0;
+
+        // WAIT_TIMEOUT and WAIT_IO_COMPLETION are reported as errors, as GetOverlappedResultEx does
+        if (result < WAIT_OBJECT_0 || result >= (WAIT_OBJECT_0 + count))
+            return result;
+
+        return win32_err_t<HANDLE>::success(handles[result - WAIT_OBJECT_0]);
+    }
+
     template<typename... THandleArgs>
     win32_err_t<HANDLE> wait_for_all_objects(
         THandleArgs const &... handleObjects)
@@ -5,6 +5,7 @@
 #include "resource_handle.h"
 #include "result.h"
 #include "primitives.h"
+#include "event.h"
 
 namespace wtl
 {
@@ -14,13 +15,18 @@ namespace wtl
     public:
         overlapped(std::uint32_t offset = 0, std::uint32_t offsetHigh = 0, HANDLE event = NULL)
         {
-            ol.Offset = 0;
+            ol.Offset = offset;
             ol.OffsetHigh = offsetHigh;
             ol.hEvent = event;
         }
 
         explicit overlapped(HANDLE event) : overlapped(0, 0, event) { }
 
+        static overlapped at(std::uint64_t offset, HANDLE event = NULL)
+        {
+            return overlapped(static_cast<std::uint32_t>(offset), static_cast<std::uint32_t>(offset >> 32), event);
+        }
+
         LPOVERLAPPED get() { return &ol; }
 
         win32_err_t<DWORD> get_num_bytes_read(HANDLE file, dword_milliseconds timeout = infinite, bool alertable = false)
@@ -31,6 +37,25 @@ namespace wtl
 
             return win32_err_t<DWORD>::success(bytesTransferred);
         }
+
+        win32_err_t<DWORD> get_num_bytes_read(HANDLE file, deadline until, bool alertable = false)
+        {
+            // the low bit of hEvent only suppresses completion port notification
+            auto waitOn = ol.hEvent ? reinterpret_cast<HANDLE>(reinterpret_cast<ULONG_PTR>(ol.hEvent) & ~ULONG_PTR(1)) : file;
+
+            if (!HasOverlappedIoCompleted(&ol))
+            {
+                auto result = details::wait_until(1, &waitOn, false, until, alertable);
+                if (result == WAIT_FAILED) return GetLastError();
+                if (result != WAIT_OBJECT_0) return result;
+            }
+
+            DWORD bytesTransferred;
+            if (!::GetOverlappedResult(file, get(), &bytesTransferred, FALSE))
+                return GetLastError();
+
+            return win32_err_t<DWORD>::success(bytesTransferred);
+        }
     };
 
     class file : public handle
@@ -86,6 +111,58 @@ namespace wtl
             return read(begin, end, nullptr, overlapped);
         }
 
+        template<typename It>
+        win32_err write(It begin, It end, _Out_opt_ DWORD * bytesWritten = nullptr, _In_opt_ LPOVERLAPPED overlapped = nullptr)
+        {
+            static_assert(std::is_same<std::random_access_iterator_tag, std::iterator_traits<It>::iterator_category>::value,
+                "file::write must provide random access iterators.");
+
+            auto size = (end - begin) * sizeof(decltype(*begin));
+            if (!::WriteFile(get(), (LPCVOID)addressof(*begin), static_cast<DWORD>(size), bytesWritten, overlapped)) return GetLastError();
+
+            return ERROR_SUCCESS;
+        }
+
+        template<typename It>
+        win32_err write(It begin, It end, _In_ LPOVERLAPPED overlapped)
+        {
+            return write(begin, end, nullptr, overlapped);
+        }
+
+        win32_err flush_buffers()
+        {
+            if (!::FlushFileBuffers(get())) return GetLastError();
+
+            return ERROR_SUCCESS;
+        }
+
+        // Physical sector size of the volume backing the file; unbuffered I/O offsets,
+        // lengths and buffer addresses must be multiples of it.
+        win32_err_t<FILE_STORAGE_INFO> get_storage_info() const
+        {
+            FILE_STORAGE_INFO storageInfo = {};
+            if (!::GetFileInformationByHandleEx(get(), FileStorageInfo, &storageInfo, sizeof(storageInfo))) return GetLastError();
+
+            return win32_err_t<FILE_STORAGE_INFO>::success(storageInfo);
+        }
+
+        // The logical sector size, which is what unbuffered I/O has to be aligned to.
+        win32_err_t<DWORD> get_sector_size() const
+        {
+            RETURN_OR_UNWRAP(storageInfo, get_storage_info());
+
+            return win32_err_t<DWORD>::success(storageInfo.LogicalBytesPerSector);
+        }
+
+        // The physical sector size the device performs best at; larger than the logical size on
+        // 512e drives, where smaller writes cost a read-modify-write.
+        win32_err_t<DWORD> get_performance_sector_size() const
+        {
+            RETURN_OR_UNWRAP(storageInfo, get_storage_info());
+
+            return win32_err_t<DWORD>::success(storageInfo.PhysicalBytesPerSectorForPerformance);
+        }
+
         win32_err cancel(LPOVERLAPPED overlapped = nullptr)
         {
             if (!::CancelIoEx(get(), overlapped)) return GetLastError();
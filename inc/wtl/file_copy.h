@@ -0,0 +1,238 @@
+#pragma once
+
+#include <windows.h>
+#include <winioctl.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "file.h"
+#include "result.h"
+
+#ifdef _WINSOCK2API_
+#include <MSWSock.h>
+#pragma comment(lib, "Mswsock.lib")
+#endif
+
+namespace wtl
+{
+    namespace details
+    {
+        struct no_progress
+        {
+            bool operator()(std::uint64_t, std::uint64_t) const { return true; }
+        };
+
+        constexpr DWORD copy_buffer_size = 1024 * 1024;
+
+        template<typename Progress>
+        win32_err_t<std::uint64_t> buffered_copy_range(
+            HANDLE src, std::uint64_t srcOffset,
+            HANDLE dst, std::uint64_t dstOffset,
+            std::uint64_t length,
+            Progress& progress,
+            bool seekableDestination = true)
+        {
+            std::unique_ptr<std::uint8_t[]> buffer(new (std::nothrow) std::uint8_t[copy_buffer_size]);
+            if (!buffer) return ERROR_NOT_ENOUGH_MEMORY;
+
+            std::uint64_t copied = 0;
+            while (copied < length)
+            {
+                auto chunk = static_cast<DWORD>(std::min<std::uint64_t>(length - copied, copy_buffer_size));
+
+                DWORD bytesRead = 0;
+                auto readAt = overlapped::at(srcOffset + copied);
+                if (!::ReadFile(src, buffer.get(), chunk, &bytesRead, readAt.get()))
+                {
+                    auto err = GetLastError();
+                    if (err != ERROR_HANDLE_EOF) return err;
+                }
+
+                if (bytesRead == 0) break;
+
+                DWORD written = 0;
+                while (written < bytesRead)
+                {
+                    DWORD bytesWritten = 0;
+                    auto writeAt = overlapped::at(dstOffset + copied + written);
+                    if (!::WriteFile(dst, buffer.get() + written, bytesRead - written, &bytesWritten, seekableDestination ? writeAt.get() : nullptr)) return GetLastError();
+
+                    written += bytesWritten;
+                }
+
+                copied += bytesRead;
+
+                if (!progress(copied, length)) return ERROR_CANCELLED;
+            }
+
+            return win32_err_t<std::uint64_t>::success(copied);
+        }
+
+        template<typename Progress>
+        DWORD CALLBACK copy_progress_routine(
+            LARGE_INTEGER totalFileSize,
+            LARGE_INTEGER totalBytesTransferred,
+            LARGE_INTEGER, LARGE_INTEGER, DWORD, DWORD, HANDLE, HANDLE,
+            LPVOID context)
+        {
+            auto & progress = *static_cast<Progress *>(context);
+
+            return progress(static_cast<std::uint64_t>(totalBytesTransferred.QuadPart), static_cast<std::uint64_t>(totalFileSize.QuadPart))
+                ? PROGRESS_CONTINUE
+                : PROGRESS_CANCEL;
+        }
+
+#ifdef FSCTL_DUPLICATE_EXTENTS_TO_FILE
+        // Clones the longest cluster-aligned prefix of the range that lies inside the source
+        // file, extending the destination first since the clone never moves its end of file.
+        // Returns the number of bytes cloned; 0 means the caller should copy everything itself.
+        inline win32_err_t<std::uint64_t> duplicate_extents(
+            HANDLE src, std::uint64_t srcOffset,
+            HANDLE dst, std::uint64_t dstOffset,
+            std::uint64_t length)
+        {
+            FSCTL_GET_INTEGRITY_INFORMATION_BUFFER integrity = {};
+            DWORD returned;
+            if (!::DeviceIoControl(dst, FSCTL_GET_INTEGRITY_INFORMATION, nullptr, 0, &integrity, sizeof(integrity), &returned, nullptr))
+            {
+                return win32_err_t<std::uint64_t>::success(0);
+            }
+
+            std::uint64_t clusterSize = integrity.ClusterSizeInBytes;
+            if (clusterSize == 0 || srcOffset % clusterSize != 0 || dstOffset % clusterSize != 0)
+            {
+                return win32_err_t<std::uint64_t>::success(0);
+            }
+
+            LARGE_INTEGER srcSize;
+            if (!::GetFileSizeEx(src, &srcSize)) return GetLastError();
+
+            auto available = static_cast<std::uint64_t>(srcSize.QuadPart);
+            if (available <= srcOffset) return win32_err_t<std::uint64_t>::success(0);
+
+            auto aligned = std::min(length, available - srcOffset);
+            aligned -= aligned % clusterSize;
+            if (aligned == 0) return win32_err_t<std::uint64_t>::success(0);
+
+            LARGE_INTEGER dstSize;
+            if (!::GetFileSizeEx(dst, &dstSize)) return GetLastError();
+
+            if (static_cast<std::uint64_t>(dstSize.QuadPart) < dstOffset + aligned)
+            {
+                FILE_END_OF_FILE_INFO endOfFile;
+                endOfFile.EndOfFile.QuadPart = static_cast<LONGLONG>(dstOffset + aligned);
+                if (!::SetFileInformationByHandle(dst, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile))) return GetLastError();
+            }
+
+            DUPLICATE_EXTENTS_DATA duplicate = {};
+            duplicate.FileHandle = src;
+            duplicate.SourceFileOffset.QuadPart = static_cast<LONGLONG>(srcOffset);
+            duplicate.TargetFileOffset.QuadPart = static_cast<LONGLONG>(dstOffset);
+            duplicate.ByteCount.QuadPart = static_cast<LONGLONG>(aligned);
+
+            if (!::DeviceIoControl(dst, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &duplicate, sizeof(duplicate), nullptr, 0, &returned, nullptr))
+            {
+                // leave the extended destination to the buffered copy, which overwrites it anyway
+                return win32_err_t<std::uint64_t>::success(0);
+            }
+
+            return win32_err_t<std::uint64_t>::success(aligned);
+        }
+#endif
+    }
+
+    // Copies 'length' bytes between two synchronous handles at explicit offsets. When both files live
+    // on a volume that supports block cloning (ReFS) and both offsets are cluster aligned, the
+    // whole clusters are cloned with a metadata-only FSCTL_DUPLICATE_EXTENTS_TO_FILE and only the
+    // tail goes through the positional read/write loop. progress(copied, total) is called after
+    // each step and may return false to stop with ERROR_CANCELLED.
+    //
+    // Returns the number of bytes copied, which is less than 'length' only if the source ends first.
+    template<typename Progress = details::no_progress>
+    win32_err_t<std::uint64_t> copy_range(
+        file const & src, std::uint64_t srcOffset,
+        file const & dst, std::uint64_t dstOffset,
+        std::uint64_t length,
+        Progress progress = Progress())
+    {
+        if (length == 0) return win32_err_t<std::uint64_t>::success(0);
+
+        std::uint64_t cloned = 0;
+
+#ifdef FSCTL_DUPLICATE_EXTENTS_TO_FILE
+        RETURN_OR_UNWRAP(duplicated, details::duplicate_extents(src.get(), srcOffset, dst.get(), dstOffset, length));
+        cloned = duplicated;
+
+        if (cloned != 0 && !progress(cloned, length)) return ERROR_CANCELLED;
+        if (cloned == length) return win32_err_t<std::uint64_t>::success(cloned);
+#endif
+
+        auto tailProgress = [&](std::uint64_t copied, std::uint64_t) { return progress(cloned + copied, length); };
+
+        RETURN_OR_UNWRAP(copied, details::buffered_copy_range(src.get(), srcOffset + cloned, dst.get(), dstOffset + cloned, length - cloned, tailProgress));
+
+        return win32_err_t<std::uint64_t>::success(cloned + copied);
+    }
+
+    // Whole-file copy through CopyFileExW, which lets the system pick the transfer strategy
+    // (including server-side copies over SMB). COPY_FILE_NO_BUFFERING is a good addition to
+    // 'flags' for files larger than a few hundred megabytes.
+    template<typename Progress = details::no_progress>
+    win32_err copy_file(
+        _In_ PCWSTR existingFileName,
+        _In_ PCWSTR newFileName,
+        DWORD flags = 0,
+        Progress progress = Progress())
+    {
+        if (!::CopyFileExW(existingFileName, newFileName, details::copy_progress_routine<Progress>, &progress, nullptr, flags)) return GetLastError();
+
+        return ERROR_SUCCESS;
+    }
+
+    // Sends a file range to a pipe or other byte-stream handle. There is no kernel splice for
+    // pipes on Windows, so this is the buffered loop; sockets get TransmitFile below.
+    template<typename Progress = details::no_progress>
+    win32_err_t<std::uint64_t> transfer_to(
+        file const & src, std::uint64_t srcOffset, std::uint64_t length,
+        HANDLE destination,
+        Progress progress = Progress())
+    {
+        return details::buffered_copy_range(src.get(), srcOffset, destination, 0, length, progress, false);
+    }
+
+#ifdef _WINSOCK2API_
+    // Sends a file range to a connected socket with TransmitFile, so the data goes from the cache
+    // manager to the network stack without a user-mode copy. The source handle must be
+    // synchronous; TransmitFile reads from its file pointer, which is moved to srcOffset.
+    template<typename Progress = details::no_progress>
+    win32_err_t<std::uint64_t> transfer_to(
+        file const & src, std::uint64_t srcOffset, std::uint64_t length,
+        SOCKET destination,
+        Progress progress = Progress())
+    {
+        // TransmitFile is limited to INT_MAX - 1 bytes per call
+        const std::uint64_t maxChunk = 0x7FFFFFFE - 0x7FFFFFFE % (64 * 1024);
+
+        std::uint64_t sent = 0;
+        while (sent < length)
+        {
+            LARGE_INTEGER position;
+            position.QuadPart = static_cast<LONGLONG>(srcOffset + sent);
+            if (!::SetFilePointerEx(src.get(), position, nullptr, FILE_BEGIN)) return GetLastError();
+
+            auto chunk = static_cast<DWORD>(std::min(length - sent, maxChunk));
+            if (!::TransmitFile(destination, src.get(), chunk, 0, nullptr, nullptr, TF_USE_KERNEL_APC))
+            {
+                return static_cast<DWORD>(::WSAGetLastError());
+            }
+
+            sent += chunk;
+
+            if (!progress(sent, length)) return ERROR_CANCELLED;
+        }
+
+        return win32_err_t<std::uint64_t>::success(sent);
+    }
+#endif
+}
\ No newline at end of file
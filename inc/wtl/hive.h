@@ -0,0 +1,658 @@
+#pragma once
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.h"
+#include "multi_sz.h"
+#include "result.h"
+
+namespace wtl
+{
+    struct hive_bytes
+    {
+        std::uint8_t const * data;
+        size_t size;
+    };
+
+    namespace details
+    {
+        template<typename T>
+        T read_le(std::uint8_t const * p)
+        {
+            T value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        // Registry names compare case-insensitively under upper-casing.
+        inline wchar_t fold_char(wchar_t c)
+        {
+            if (c < 0x80) return (c >= L'a' && c <= L'z') ? static_cast<wchar_t>(c - (L'a' - L'A')) : c;
+
+            return static_cast<wchar_t>(reinterpret_cast<ULONG_PTR>(::CharUpperW(reinterpret_cast<LPWSTR>(static_cast<ULONG_PTR>(c)))));
+        }
+
+        // The hash stored in "lh" subkey lists.
+        inline std::uint32_t lh_hash(wchar_t const * name, size_t length)
+        {
+            std::uint32_t hash = 0;
+            for (size_t i = 0; i < length; i++)
+            {
+                hash = hash * 37 + fold_char(name[i]);
+            }
+
+            return hash;
+        }
+
+        // The hive bins of a regf file. Cell offsets are relative to the first bin.
+        struct hive_data
+        {
+            std::uint8_t const * bins = nullptr;
+            size_t size = 0;
+
+            // Body of the allocated cell at 'offset', or nullptr if it is out of range or free.
+            std::uint8_t const * cell(std::uint32_t offset, size_t & bodySize) const
+            {
+                if (offset >= size || size - offset < 4) return nullptr;
+
+                auto raw = read_le<std::int32_t>(bins + offset);
+                if (raw >= 0) return nullptr;
+
+                auto cellSize = static_cast<size_t>(-static_cast<std::int64_t>(raw));
+                if (cellSize < 4 || cellSize > size - offset) return nullptr;
+
+                bodySize = cellSize - 4;
+                return bins + offset + 4;
+            }
+
+            bool has_signature(std::uint8_t const * body, size_t bodySize, char const (&signature)[3]) const
+            {
+                return bodySize >= 2 && body[0] == signature[0] && body[1] == signature[1];
+            }
+        };
+
+        // Calls fn(keyOffset, hash, hasHash) for every entry of a subkey list, following one level
+        // of "ri" indirection. fn returns false to stop.
+        template<typename Fn>
+        DWORD walk_subkey_list(hive_data const & hive, std::uint32_t listOffset, Fn & fn, bool & stopped, bool nested = false)
+        {
+            size_t size;
+            auto list = hive.cell(listOffset, size);
+            if (!list || size < 4) return ERROR_REGISTRY_CORRUPT;
+
+            auto count = read_le<std::uint16_t>(list + 2);
+            auto hashed = hive.has_signature(list, size, "lh");
+
+            if (hashed || hive.has_signature(list, size, "lf"))
+            {
+                if (4 + size_t(count) * 8 > size) return ERROR_REGISTRY_CORRUPT;
+
+                for (std::uint16_t i = 0; i < count; i++)
+                {
+                    auto entry = list + 4 + i * 8;
+                    if (!fn(read_le<std::uint32_t>(entry), read_le<std::uint32_t>(entry + 4), hashed))
+                    {
+                        stopped = true;
+                        return ERROR_SUCCESS;
+                    }
+                }
+
+                return ERROR_SUCCESS;
+            }
+
+            bool indirect = hive.has_signature(list, size, "ri");
+            if (!indirect && !hive.has_signature(list, size, "li")) return ERROR_REGISTRY_CORRUPT;
+            if (indirect && nested) return ERROR_REGISTRY_CORRUPT;
+            if (4 + size_t(count) * 4 > size) return ERROR_REGISTRY_CORRUPT;
+
+            for (std::uint16_t i = 0; i < count; i++)
+            {
+                auto offset = read_le<std::uint32_t>(list + 4 + i * 4);
+
+                if (indirect)
+                {
+                    auto err = walk_subkey_list(hive, offset, fn, stopped, true);
+                    if (err != ERROR_SUCCESS || stopped) return err;
+                }
+                else if (!fn(offset, 0, false))
+                {
+                    stopped = true;
+                    return ERROR_SUCCESS;
+                }
+            }
+
+            return ERROR_SUCCESS;
+        }
+    }
+
+    // A key or value name as stored in the hive: Latin-1 when the hive compressed it, UTF-16
+    // otherwise. Points into the hive.
+    class hive_name
+    {
+        std::uint8_t const * m_data;
+        size_t m_length;
+        bool m_compressed;
+
+    public:
+        hive_name(std::uint8_t const * data, size_t length, bool compressed) : m_data(data), m_length(length), m_compressed(compressed) { }
+
+        size_t length() const
+        {
+            return m_length;
+        }
+
+        wchar_t operator[](size_t i) const
+        {
+            return m_compressed ? static_cast<wchar_t>(m_data[i]) : static_cast<wchar_t>(details::read_le<std::uint16_t>(m_data + 2 * i));
+        }
+
+        std::wstring str() const
+        {
+            std::wstring out(m_length, L'\0');
+            for (size_t i = 0; i < m_length; i++) out[i] = (*this)[i];
+
+            return out;
+        }
+
+        // Case-insensitive, as the registry compares names.
+        bool equals(wchar_t const * name, size_t length) const
+        {
+            if (length != m_length) return false;
+
+            for (size_t i = 0; i < length; i++)
+            {
+                if (details::fold_char((*this)[i]) != details::fold_char(name[i])) return false;
+            }
+
+            return true;
+        }
+    };
+
+    class hive_value
+    {
+        static const std::uint32_t big_data_segment = 16344;
+
+        details::hive_data m_hive;
+        std::uint8_t const * m_node = nullptr;
+
+        std::uint32_t raw_size() const
+        {
+            return details::read_le<std::uint32_t>(m_node + 4);
+        }
+
+    public:
+        // Validates a "vk" cell.
+        static win32_err_t<hive_value> at(details::hive_data const & hive, std::uint32_t offset)
+        {
+            size_t size;
+            auto node = hive.cell(offset, size);
+            if (!node || size < 20 || !hive.has_signature(node, size, "vk")) return ERROR_REGISTRY_CORRUPT;
+
+            auto nameLength = details::read_le<std::uint16_t>(node + 2);
+            if (20 + size_t(nameLength) > size) return ERROR_REGISTRY_CORRUPT;
+
+            hive_value value;
+            value.m_hive = hive;
+            value.m_node = node;
+
+            return win32_err_t<hive_value>::success(value);
+        }
+
+        // Empty for the key's default value.
+        hive_name name() const
+        {
+            auto length = details::read_le<std::uint16_t>(m_node + 2);
+            auto compressed = (details::read_le<std::uint16_t>(m_node + 16) & 0x0001) != 0;
+
+            return hive_name(m_node + 20, compressed ? length : length / 2, compressed);
+        }
+
+        DWORD type() const
+        {
+            return details::read_le<std::uint32_t>(m_node + 12);
+        }
+
+        DWORD size() const
+        {
+            return raw_size() & 0x7FFFFFFF;
+        }
+
+        // The value's bytes, in place. Values too large for one cell are split into segments;
+        // those return ERROR_NOT_SUPPORTED and need copy_data().
+        win32_err_t<hive_bytes> data() const
+        {
+            auto size = this->size();
+
+            // up to four bytes live in the data offset field itself
+            if ((raw_size() & 0x80000000) != 0 || size == 0)
+            {
+                if (size > 4) return ERROR_REGISTRY_CORRUPT;
+
+                hive_bytes bytes = { m_node + 8, size };
+                return win32_err_t<hive_bytes>::success(bytes);
+            }
+
+            size_t cellSize;
+            auto cell = m_hive.cell(details::read_le<std::uint32_t>(m_node + 8), cellSize);
+            if (!cell) return ERROR_REGISTRY_CORRUPT;
+
+            if (cellSize < size)
+            {
+                if (size > big_data_segment && m_hive.has_signature(cell, cellSize, "db")) return ERROR_NOT_SUPPORTED;
+                return ERROR_REGISTRY_CORRUPT;
+            }
+
+            hive_bytes bytes = { cell, size };
+            return win32_err_t<hive_bytes>::success(bytes);
+        }
+
+        // REG_MULTI_SZ data as a view into the hive. ERROR_INVALID_DATA if the strings are not
+        // terminated within the value.
+        win32_err_t<multi_sz_view> get_multi_sz() const
+        {
+            if (type() != REG_MULTI_SZ) return ERROR_INVALID_DATATYPE;
+
+            RETURN_OR_UNWRAP(bytes, data());
+
+            auto count = bytes.size / sizeof(wchar_t);
+            if (count == 0) return win32_err_t<multi_sz_view>::success(multi_sz_view(L""));
+
+            // the view stops at the first empty string, which has to be inside the data
+            for (size_t i = 0; i < count; i++)
+            {
+                if (details::read_le<std::uint16_t>(bytes.data + 2 * i) == 0 && (i == 0 || details::read_le<std::uint16_t>(bytes.data + 2 * (i - 1)) == 0))
+                {
+                    return win32_err_t<multi_sz_view>::success(multi_sz_view(reinterpret_cast<wchar_t const *>(bytes.data)));
+                }
+            }
+
+            return ERROR_INVALID_DATA;
+        }
+
+        // Copies the value's bytes, including segmented big data.
+        win32_err copy_data(std::vector<std::uint8_t> & out) const
+        {
+            out.clear();
+
+            auto bytes = data();
+            if (bytes)
+            {
+                out.assign(bytes.get().data, bytes.get().data + bytes.get().size);
+                return ERROR_SUCCESS;
+            }
+
+            if (bytes.get_result() != ERROR_NOT_SUPPORTED) return bytes.get_result();
+
+            size_t dbSize;
+            auto db = m_hive.cell(details::read_le<std::uint32_t>(m_node + 8), dbSize);
+            if (!db || dbSize < 8) return ERROR_REGISTRY_CORRUPT;
+
+            auto segments = details::read_le<std::uint16_t>(db + 2);
+
+            size_t listSize;
+            auto list = m_hive.cell(details::read_le<std::uint32_t>(db + 4), listSize);
+            if (!list || size_t(segments) * 4 > listSize) return ERROR_REGISTRY_CORRUPT;
+
+            size_t remaining = size();
+            out.reserve(remaining);
+
+            for (std::uint16_t i = 0; i < segments && remaining != 0; i++)
+            {
+                size_t segmentSize;
+                auto segment = m_hive.cell(details::read_le<std::uint32_t>(list + 4 * i), segmentSize);
+                if (!segment) return ERROR_REGISTRY_CORRUPT;
+
+                auto take = std::min<size_t>(std::min<size_t>(remaining, big_data_segment), segmentSize);
+                out.insert(out.end(), segment, segment + take);
+                remaining -= take;
+            }
+
+            if (remaining != 0) return ERROR_REGISTRY_CORRUPT;
+
+            return ERROR_SUCCESS;
+        }
+    };
+
+    class hive_key
+    {
+        details::hive_data m_hive;
+        std::uint32_t m_offset = 0;
+        std::uint8_t const * m_node = nullptr;
+
+    public:
+        // Validates an "nk" cell.
+        static win32_err_t<hive_key> at(details::hive_data const & hive, std::uint32_t offset)
+        {
+            size_t size;
+            auto node = hive.cell(offset, size);
+            if (!node || size < 76 || !hive.has_signature(node, size, "nk")) return ERROR_REGISTRY_CORRUPT;
+
+            auto nameLength = details::read_le<std::uint16_t>(node + 72);
+            if (76 + size_t(nameLength) > size) return ERROR_REGISTRY_CORRUPT;
+
+            hive_key key;
+            key.m_hive = hive;
+            key.m_offset = offset;
+            key.m_node = node;
+
+            return win32_err_t<hive_key>::success(key);
+        }
+
+        std::uint32_t offset() const
+        {
+            return m_offset;
+        }
+
+        hive_name name() const
+        {
+            auto length = details::read_le<std::uint16_t>(m_node + 72);
+            auto compressed = (details::read_le<std::uint16_t>(m_node + 2) & 0x0020) != 0;
+
+            return hive_name(m_node + 76, compressed ? length : length / 2, compressed);
+        }
+
+        FILETIME last_write_time() const
+        {
+            return details::read_le<FILETIME>(m_node + 4);
+        }
+
+        std::uint32_t subkey_count() const
+        {
+            return details::read_le<std::uint32_t>(m_node + 20);
+        }
+
+        std::uint32_t value_count() const
+        {
+            return details::read_le<std::uint32_t>(m_node + 36);
+        }
+
+        // Calls callback(hive_key const &) for each subkey, in stored order, until it returns false.
+        template<typename Callback>
+        win32_err for_each_subkey(Callback&& callback) const
+        {
+            if (subkey_count() == 0) return ERROR_SUCCESS;
+
+            DWORD err = ERROR_SUCCESS;
+            auto visit = [&](std::uint32_t offset, std::uint32_t, bool)
+            {
+                auto key = at(m_hive, offset);
+                if (!key)
+                {
+                    err = key.get_result();
+                    return false;
+                }
+
+                return static_cast<bool>(callback(static_cast<hive_key const &>(key.get())));
+            };
+
+            bool stopped = false;
+            auto walked = details::walk_subkey_list(m_hive, details::read_le<std::uint32_t>(m_node + 28), visit, stopped);
+
+            return walked != ERROR_SUCCESS ? walked : err;
+        }
+
+        // ERROR_FILE_NOT_FOUND if there is no such subkey.
+        win32_err_t<hive_key> subkey(wchar_t const * name, size_t length) const
+        {
+            if (subkey_count() == 0) return ERROR_FILE_NOT_FOUND;
+
+            auto hash = details::lh_hash(name, length);
+
+            DWORD err = ERROR_FILE_NOT_FOUND;
+            hive_key found;
+
+            auto visit = [&](std::uint32_t offset, std::uint32_t entryHash, bool hasHash)
+            {
+                // "lh" lists let most entries be skipped without touching their key cell
+                if (hasHash && entryHash != hash) return true;
+
+                auto key = at(m_hive, offset);
+                if (!key)
+                {
+                    err = key.get_result();
+                    return false;
+                }
+
+                if (!key.get().name().equals(name, length)) return true;
+
+                found = key.get();
+                err = ERROR_SUCCESS;
+                return false;
+            };
+
+            bool stopped = false;
+            auto walked = details::walk_subkey_list(m_hive, details::read_le<std::uint32_t>(m_node + 28), visit, stopped);
+            if (walked != ERROR_SUCCESS) return walked;
+            if (err != ERROR_SUCCESS) return err;
+
+            return win32_err_t<hive_key>::success(found);
+        }
+
+        win32_err_t<hive_key> subkey(PCWSTR name) const
+        {
+            return subkey(name, wcslen(name));
+        }
+
+        // Walks a backslash separated path of subkeys below this key.
+        win32_err_t<hive_key> open(PCWSTR path) const
+        {
+            auto current = *this;
+
+            while (*path)
+            {
+                if (*path == L'\\')
+                {
+                    path++;
+                    continue;
+                }
+
+                auto end = path;
+                while (*end && *end != L'\\') end++;
+
+                RETURN_OR_UNWRAP(next, current.subkey(path, end - path));
+                current = next;
+                path = end;
+            }
+
+            return win32_err_t<hive_key>::success(current);
+        }
+
+        // Calls callback(hive_value const &) for each value until it returns false.
+        template<typename Callback>
+        win32_err for_each_value(Callback&& callback) const
+        {
+            auto count = value_count();
+            if (count == 0) return ERROR_SUCCESS;
+
+            size_t size;
+            auto list = m_hive.cell(details::read_le<std::uint32_t>(m_node + 40), size);
+            if (!list || size_t(count) * 4 > size) return ERROR_REGISTRY_CORRUPT;
+
+            for (std::uint32_t i = 0; i < count; i++)
+            {
+                RETURN_OR_UNWRAP(value, hive_value::at(m_hive, details::read_le<std::uint32_t>(list + 4 * i)));
+                if (!callback(static_cast<hive_value const &>(value))) break;
+            }
+
+            return ERROR_SUCCESS;
+        }
+
+        // Empty name for the default value. ERROR_FILE_NOT_FOUND if there is no such value.
+        win32_err_t<hive_value> value(PCWSTR name) const
+        {
+            auto length = wcslen(name);
+
+            DWORD err = ERROR_FILE_NOT_FOUND;
+            hive_value found;
+
+            auto walked = for_each_value([&](hive_value const & value)
+            {
+                if (!value.name().equals(name, length)) return true;
+
+                found = value;
+                err = ERROR_SUCCESS;
+                return false;
+            });
+
+            if (!walked) return walked.get_result();
+            if (err != ERROR_SUCCESS) return err;
+
+            return win32_err_t<hive_value>::success(found);
+        }
+    };
+
+    // Read-only view of a regf registry hive file, as saved by RegSaveKey or copied from
+    // %SystemRoot%\System32\config. Nothing is parsed up front: keys and values are decoded from
+    // the mapped file as they are visited, and values come back as views into it.
+    //
+    // Path lookups walk one level at a time using the hashes in "lh" subkey lists.
+    // build_index() trades one full traversal for constant-time lookups afterwards. Keys and
+    // values stay valid while the hive lives; moving the hive does not invalidate them.
+    class hive
+    {
+        mapped_file m_file;
+        details::hive_data m_data;
+        std::uint32_t m_root = 0;
+        std::unordered_map<std::wstring, std::uint32_t> m_index;
+
+        static const size_t base_block_size = 4096;
+
+        static win32_err parse(std::uint8_t const * data, size_t size, details::hive_data & bins, std::uint32_t & root)
+        {
+            if (size < base_block_size || std::memcmp(data, "regf", 4) != 0) return ERROR_BADDB;
+
+            auto binsSize = details::read_le<std::uint32_t>(data + 0x28);
+            if (binsSize > size - base_block_size) return ERROR_BADDB;
+
+            bins.bins = data + base_block_size;
+            bins.size = binsSize;
+            root = details::read_le<std::uint32_t>(data + 0x24);
+
+            auto rootKey = hive_key::at(bins, root);
+            if (!rootKey) return ERROR_BADDB;
+
+            return ERROR_SUCCESS;
+        }
+
+        static void append_folded(std::wstring & path, hive_name const & name)
+        {
+            for (size_t i = 0; i < name.length(); i++)
+            {
+                path.push_back(details::fold_char(name[i]));
+            }
+        }
+
+        win32_err index_subtree(hive_key const & key, std::wstring & path, unsigned depth)
+        {
+            // the registry allows at most 512 levels; deeper means a cycle in a corrupt hive
+            if (depth > 512) return ERROR_REGISTRY_CORRUPT;
+
+            m_index[path] = key.offset();
+
+            auto length = path.size();
+            DWORD err = ERROR_SUCCESS;
+
+            auto walked = key.for_each_subkey([&](hive_key const & subkey)
+            {
+                if (length != 0) path.push_back(L'\\');
+                append_folded(path, subkey.name());
+
+                auto indexed = index_subtree(subkey, path, depth + 1);
+                path.resize(length);
+
+                err = indexed.get_result();
+                return err == ERROR_SUCCESS;
+            });
+
+            if (!walked) return walked;
+
+            return err;
+        }
+
+    public:
+        hive() { }
+
+        hive(hive&& other) = default;
+        hive & operator=(hive&& other) = default;
+
+        static win32_err_t<hive> open(PCWSTR fileName)
+        {
+            RETURN_OR_UNWRAP(mapped, mapped_file::open_read(fileName));
+
+            hive h;
+            auto parsed = parse(mapped.data(), mapped.size(), h.m_data, h.m_root);
+            if (!parsed) return parsed.get_result();
+
+            h.m_file = std::move(mapped);
+
+            return win32_err_t<hive>::success(std::move(h));
+        }
+
+        // A hive already in memory. The memory must outlive the hive and everything read from it.
+        static win32_err_t<hive> attach(void const * data, size_t size)
+        {
+            hive h;
+            auto parsed = parse(static_cast<std::uint8_t const *>(data), size, h.m_data, h.m_root);
+            if (!parsed) return parsed.get_result();
+
+            return win32_err_t<hive>::success(std::move(h));
+        }
+
+        // Fails on a default-constructed hive, which has no root key.
+        win32_err_t<hive_key> root() const
+        {
+            return hive_key::at(m_data, m_root);
+        }
+
+        // Path relative to the root key, backslash separated and case-insensitive. Leading,
+        // trailing and repeated backslashes are ignored, as in hive_key::open().
+        win32_err_t<hive_key> open_key(PCWSTR path) const
+        {
+            if (m_index.empty())
+            {
+                RETURN_OR_UNWRAP(rootKey, root());
+                return rootKey.open(path);
+            }
+
+            std::wstring folded;
+            for (; *path; path++)
+            {
+                if (*path == L'\\' && (folded.empty() || folded.back() == L'\\')) continue;
+
+                folded.push_back(details::fold_char(*path));
+            }
+
+            while (!folded.empty() && folded.back() == L'\\') folded.pop_back();
+
+            auto found = m_index.find(folded);
+            if (found == m_index.end()) return ERROR_FILE_NOT_FOUND;
+
+            return hive_key::at(m_data, found->second);
+        }
+
+        // Indexes every key path for open_key(). Returns the number of keys.
+        win32_err_t<size_t> build_index()
+        {
+            m_index.clear();
+
+            RETURN_OR_UNWRAP(rootKey, root());
+
+            std::wstring path;
+            auto indexed = index_subtree(rootKey, path, 0);
+            if (!indexed)
+            {
+                m_index.clear();
+                return indexed.get_result();
+            }
+
+            return win32_err_t<size_t>::success(m_index.size());
+        }
+    };
+}
\ No newline at end of file
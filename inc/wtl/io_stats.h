@@ -0,0 +1,381 @@
+#pragma once
+
+#include <windows.h>
+#include <intrin.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include "file.h"
+#include "result.h"
+
+// Define WTL_DISABLE_IO_STATS to compile every io_stats operation down to nothing while keeping
+// the same API, so instrumented call sites do not need their own #ifdefs.
+
+namespace wtl
+{
+    enum class io_kind
+    {
+        read,
+        write
+    };
+
+    // Log-linear latency histogram in nanoseconds: values below 8 get exact buckets, larger
+    // values get 8 sub-buckets per power of two, so any recorded value is within 12.5% of its
+    // bucket's lower bound. Plain counters; io_stats merges per-shard atomics into these.
+    class latency_histogram
+    {
+    public:
+        static constexpr unsigned sub_bucket_bits = 3;
+        static constexpr unsigned sub_bucket_count = 1u << sub_bucket_bits;
+        static constexpr unsigned bucket_count = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+
+    private:
+        std::array<std::uint64_t, bucket_count> m_counts = {};
+        std::uint64_t m_total = 0;
+
+        static unsigned most_significant_bit(std::uint64_t value)
+        {
+            unsigned long index;
+            auto high = static_cast<unsigned long>(value >> 32);
+            if (high != 0 && _BitScanReverse(&index, high)) return index + 32;
+
+            _BitScanReverse(&index, static_cast<unsigned long>(value));
+            return index;
+        }
+
+    public:
+        static unsigned bucket_index(std::uint64_t nanoseconds)
+        {
+            if (nanoseconds < sub_bucket_count) return static_cast<unsigned>(nanoseconds);
+
+            auto magnitude = most_significant_bit(nanoseconds);
+            auto sub = static_cast<unsigned>(nanoseconds >> (magnitude - sub_bucket_bits)) & (sub_bucket_count - 1);
+
+            return (magnitude - sub_bucket_bits + 1) * sub_bucket_count + sub;
+        }
+
+        static std::uint64_t bucket_lower_bound(unsigned index)
+        {
+            if (index < sub_bucket_count) return index;
+
+            auto magnitude = index / sub_bucket_count + sub_bucket_bits - 1;
+            auto sub = index % sub_bucket_count;
+
+            return static_cast<std::uint64_t>(sub_bucket_count + sub) << (magnitude - sub_bucket_bits);
+        }
+
+        void add(unsigned index, std::uint64_t count)
+        {
+            m_counts[index] += count;
+            m_total += count;
+        }
+
+        void record(std::uint64_t nanoseconds)
+        {
+            add(bucket_index(nanoseconds), 1);
+        }
+
+        void merge(latency_histogram const & other)
+        {
+            for (unsigned i = 0; i < bucket_count; i++)
+            {
+                m_counts[i] += other.m_counts[i];
+            }
+
+            m_total += other.m_total;
+        }
+
+        std::uint64_t count() const
+        {
+            return m_total;
+        }
+
+        // Lower bound of the bucket holding the given percentile (0-100).
+        std::uint64_t percentile(double p) const
+        {
+            if (m_total == 0) return 0;
+
+            auto rank = static_cast<std::uint64_t>(p / 100.0 * static_cast<double>(m_total - 1));
+            std::uint64_t seen = 0;
+
+            for (unsigned i = 0; i < bucket_count; i++)
+            {
+                seen += m_counts[i];
+                if (seen > rank) return bucket_lower_bound(i);
+            }
+
+            return bucket_lower_bound(bucket_count - 1);
+        }
+
+        // Calls visitor(lowerBoundNs, count) for every non-empty bucket, in increasing order.
+        template<typename Visitor>
+        void for_each_bucket(Visitor&& visitor) const
+        {
+            for (unsigned i = 0; i < bucket_count; i++)
+            {
+                if (m_counts[i] != 0)
+                {
+                    visitor(bucket_lower_bound(i), m_counts[i]);
+                }
+            }
+        }
+    };
+
+    struct io_stats_snapshot
+    {
+        std::uint64_t reads = 0;
+        std::uint64_t writes = 0;
+        std::uint64_t bytes_read = 0;
+        std::uint64_t bytes_written = 0;
+        std::uint64_t read_failures = 0;
+        std::uint64_t write_failures = 0;
+        std::int64_t in_flight = 0;
+
+        // Sum of the per-shard peaks: an upper bound on the true peak, exact when operations are
+        // issued from one thread.
+        std::int64_t max_in_flight = 0;
+
+        latency_histogram read_latency;
+        latency_histogram write_latency;
+    };
+
+    // The enabled and disabled builds get different inline namespaces, so translation units
+    // compiled with and without WTL_DISABLE_IO_STATS can be linked into one binary.
+#ifndef WTL_DISABLE_IO_STATS
+    inline namespace io_stats_enabled
+#else
+    inline namespace io_stats_disabled
+#endif
+    {
+#ifndef WTL_DISABLE_IO_STATS
+
+        // Counters for one handle. Updates go to one of a fixed set of shards picked by thread id,
+        // using relaxed atomic increments, so concurrent threads rarely touch the same counters and
+        // never take a lock. snapshot() sums the shards.
+        class io_stats
+        {
+        public:
+            static constexpr unsigned shard_count = 8;
+
+        private:
+            struct shard
+            {
+                std::atomic<std::uint64_t> operations[2];
+                std::atomic<std::uint64_t> bytes[2];
+                std::atomic<std::uint64_t> failures[2];
+                std::atomic<std::uint64_t> latency[2][latency_histogram::bucket_count];
+                std::atomic<std::int64_t> inFlight;
+                std::atomic<std::int64_t> maxInFlight;
+            };
+
+            struct state
+            {
+                shard shards[shard_count];
+
+                shard & current_shard()
+                {
+                    // thread ids are multiples of four
+                    return shards[(::GetCurrentThreadId() >> 2) % shard_count];
+                }
+            };
+
+            std::unique_ptr<state> m_state;
+
+        public:
+            // Times one operation from construction to complete() or fail().
+            class operation
+            {
+                state * m_stats;
+                io_kind m_kind;
+                std::chrono::steady_clock::time_point m_start;
+
+                // The operation leaves the in-flight count of the shard it entered, whichever
+                // thread finishes it.
+                shard * m_issued = nullptr;
+
+                void finish()
+                {
+                    --m_issued->inFlight;
+                    m_stats = nullptr;
+                }
+
+            public:
+                operation(state * stats, io_kind kind) : m_stats(stats), m_kind(kind), m_start(std::chrono::steady_clock::now())
+                {
+                    if (!m_stats) return;
+
+                    m_issued = &m_stats->current_shard();
+
+                    auto depth = ++m_issued->inFlight;
+                    auto max = m_issued->maxInFlight.load(std::memory_order_relaxed);
+                    while (depth > max && !m_issued->maxInFlight.compare_exchange_weak(max, depth, std::memory_order_relaxed));
+                }
+
+                operation(operation&& other) : m_stats(other.m_stats), m_kind(other.m_kind), m_start(other.m_start), m_issued(other.m_issued)
+                {
+                    other.m_stats = nullptr;
+                }
+
+                operation(operation const &) = delete;
+                operation & operator=(operation const &) = delete;
+
+                // Operations abandoned without complete() or fail() still leave the in-flight count.
+                ~operation()
+                {
+                    if (m_stats) finish();
+                }
+
+                void complete(std::uint64_t bytes)
+                {
+                    if (!m_stats) return;
+
+                    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+                    auto index = static_cast<unsigned>(m_kind);
+                    auto & s = m_stats->current_shard();
+
+                    s.operations[index].fetch_add(1, std::memory_order_relaxed);
+                    s.bytes[index].fetch_add(bytes, std::memory_order_relaxed);
+                    s.latency[index][latency_histogram::bucket_index(static_cast<std::uint64_t>(elapsed))].fetch_add(1, std::memory_order_relaxed);
+
+                    finish();
+                }
+
+                // Counts the operation as failed; it is left out of the latency histogram.
+                void fail()
+                {
+                    if (!m_stats) return;
+
+                    m_stats->current_shard().failures[static_cast<unsigned>(m_kind)].fetch_add(1, std::memory_order_relaxed);
+
+                    finish();
+                }
+            };
+
+            io_stats() : m_state(new state())
+            {
+                for (auto & s : m_state->shards)
+                {
+                    for (unsigned kind = 0; kind < 2; kind++)
+                    {
+                        s.operations[kind] = 0;
+                        s.bytes[kind] = 0;
+                        s.failures[kind] = 0;
+                        for (auto & bucket : s.latency[kind]) bucket = 0;
+                    }
+
+                    s.inFlight = 0;
+                    s.maxInFlight = 0;
+                }
+            }
+
+            io_stats(io_stats&& other) = default;
+            io_stats & operator=(io_stats&& other) = default;
+
+            // On a moved-from io_stats the operation records nothing.
+            operation begin(io_kind kind)
+            {
+                return operation(m_state.get(), kind);
+            }
+
+            io_stats_snapshot snapshot() const
+            {
+                io_stats_snapshot result;
+                if (!m_state) return result;
+
+                for (auto const & s : m_state->shards)
+                {
+                    result.reads += s.operations[0].load(std::memory_order_relaxed);
+                    result.writes += s.operations[1].load(std::memory_order_relaxed);
+                    result.bytes_read += s.bytes[0].load(std::memory_order_relaxed);
+                    result.bytes_written += s.bytes[1].load(std::memory_order_relaxed);
+                    result.read_failures += s.failures[0].load(std::memory_order_relaxed);
+                    result.write_failures += s.failures[1].load(std::memory_order_relaxed);
+                    result.in_flight += s.inFlight.load(std::memory_order_relaxed);
+                    result.max_in_flight += s.maxInFlight.load(std::memory_order_relaxed);
+
+                    for (unsigned b = 0; b < latency_histogram::bucket_count; b++)
+                    {
+                        result.read_latency.add(b, s.latency[0][b].load(std::memory_order_relaxed));
+                        result.write_latency.add(b, s.latency[1][b].load(std::memory_order_relaxed));
+                    }
+                }
+
+                return result;
+            }
+        };
+
+#else
+
+        class io_stats
+        {
+        public:
+            class operation
+            {
+            public:
+                void complete(std::uint64_t) { }
+                void fail() { }
+            };
+
+            operation begin(io_kind) { return operation(); }
+
+            io_stats_snapshot snapshot() const { return io_stats_snapshot(); }
+        };
+
+#endif
+
+        // A file whose synchronous reads and writes are recorded in an io_stats. Overlapped
+        // requests are passed through; take an operation from stats().begin() when issuing and
+        // complete() it with the byte count once get_num_bytes_read returns.
+        class instrumented_file : public file
+        {
+            io_stats m_stats;
+
+        public:
+            using file::read;
+            using file::write;
+
+            instrumented_file() : file() { }
+
+            explicit instrumented_file(file&& f) : file(std::move(f)) { }
+
+            io_stats & stats()
+            {
+                return m_stats;
+            }
+
+            template<typename It>
+            win32_err read(It begin, It end, _Out_opt_ DWORD * bytesRead = nullptr, _In_opt_ LPOVERLAPPED overlapped = nullptr)
+            {
+                if (overlapped) return file::read(begin, end, bytesRead, overlapped);
+
+                DWORD transferred = 0;
+                auto op = m_stats.begin(io_kind::read);
+                auto result = file::read(begin, end, &transferred);
+                if (result) op.complete(transferred);
+                else op.fail();
+
+                if (bytesRead) *bytesRead = transferred;
+                return result;
+            }
+
+            template<typename It>
+            win32_err write(It begin, It end, _Out_opt_ DWORD * bytesWritten = nullptr, _In_opt_ LPOVERLAPPED overlapped = nullptr)
+            {
+                if (overlapped) return file::write(begin, end, bytesWritten, overlapped);
+
+                DWORD transferred = 0;
+                auto op = m_stats.begin(io_kind::write);
+                auto result = file::write(begin, end, &transferred);
+                if (result) op.complete(transferred);
+                else op.fail();
+
+                if (bytesWritten) *bytesWritten = transferred;
+                return result;
+            }
+        };
+    }
+}
\ No newline at end of file
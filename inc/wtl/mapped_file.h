@@ -0,0 +1,72 @@
+#pragma once
+
+#include <windows.h>
+#include <memoryapi.h>
+
+#include <cstdint>
+
+#include "file.h"
+#include "resource_handle.h"
+#include "result.h"
+
+namespace wtl
+{
+    using file_mapping = resource_handle<HANDLE, int, NULL, decltype(::CloseHandle), ::CloseHandle>;
+    using mapped_view = resource_handle<LPVOID, int, 0, decltype(::UnmapViewOfFile), ::UnmapViewOfFile>;
+
+    // A whole file mapped read-only. Pages are faulted in as they are touched, so parsing a large
+    // file only reads the parts that are visited.
+    class mapped_file
+    {
+        file_mapping m_mapping;
+        mapped_view m_view;
+        size_t m_size = 0;
+
+    public:
+        mapped_file() { }
+
+        mapped_file(mapped_file&& other) : m_mapping(std::move(other.m_mapping)), m_view(std::move(other.m_view)), m_size(other.m_size) { }
+
+        mapped_file & operator=(mapped_file&& other)
+        {
+            m_view = std::move(other.m_view);
+            m_mapping = std::move(other.m_mapping);
+            m_size = other.m_size;
+
+            return *this;
+        }
+
+        static win32_err_t<mapped_file> open_read(PCWSTR fileName, DWORD shareMode = FILE_SHARE_READ)
+        {
+            RETURN_OR_UNWRAP(f, file::create(fileName, GENERIC_READ, shareMode));
+
+            LARGE_INTEGER size;
+            if (!::GetFileSizeEx(f.get(), &size)) return GetLastError();
+
+            // a zero length file cannot be mapped
+            if (size.QuadPart == 0) return ERROR_FILE_INVALID;
+            if (static_cast<std::uint64_t>(size.QuadPart) > SIZE_MAX) return ERROR_FILE_TOO_LARGE;
+
+            mapped_file mapped;
+            mapped.m_mapping = file_mapping(::CreateFileMappingW(f.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+            if (!mapped.m_mapping) return GetLastError();
+
+            mapped.m_view = mapped_view(::MapViewOfFile(mapped.m_mapping.get(), FILE_MAP_READ, 0, 0, 0));
+            if (!mapped.m_view) return GetLastError();
+
+            mapped.m_size = static_cast<size_t>(size.QuadPart);
+
+            return win32_err_t<mapped_file>::success(std::move(mapped));
+        }
+
+        std::uint8_t const * data() const
+        {
+            return static_cast<std::uint8_t const *>(m_view.get());
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+    };
+}
\ No newline at end of file
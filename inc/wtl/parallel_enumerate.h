@@ -0,0 +1,145 @@
+#pragma once
+
+#include <Windows.h>
+#include <cfgmgr32.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cwchar>
+#include <iterator>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "cfgmgr.h"
+#include "device_interface_cache.h"
+#include "multi_sz.h"
+#include "result.h"
+
+namespace wtl
+{
+    struct class_enumeration
+    {
+        GUID class_guid;
+        CONFIGRET result;
+
+        // Entries the class contributed, before deduplication.
+        size_t count;
+        std::chrono::microseconds elapsed;
+    };
+
+    struct device_enumeration
+    {
+        // Every entry from every class that enumerated successfully, sorted and with
+        // case-insensitive duplicates removed. Duplicates keep the earliest class's spelling.
+        multi_sz entries;
+
+        // One per requested class, in request order.
+        std::vector<class_enumeration> classes;
+    };
+
+    struct enumerate_options
+    {
+        // 0 uses std::thread::hardware_concurrency(). Never more threads than classes.
+        unsigned thread_count = 0;
+    };
+
+    // Enumerates every class GUID in [first, last) on a set of worker threads, the calling thread
+    // included, and merges the results into one deduplicated snapshot with per-class timings.
+    // Enumeration is mostly waiting on the config manager, so classes overlap well even on few
+    // cores.
+    //
+    // The backend needs a thread safe configret_t<multi_sz> get_device_interface_list(GUID const &);
+    // cm_interface_backend and fake_cfgmgr both qualify. A class that fails is reported in its
+    // class_enumeration and left out of the entries; it does not fail the whole call.
+    template<typename Backend, typename GuidIt>
+    configret_t<device_enumeration> parallel_enumerate(Backend & backend, GuidIt first, GuidIt last, enumerate_options const & options = enumerate_options())
+    {
+        static_assert(std::is_same<std::random_access_iterator_tag, typename std::iterator_traits<GuidIt>::iterator_category>::value, "GuidIt must be a random access iterator");
+
+        const auto classCount = static_cast<size_t>(last - first);
+
+        device_enumeration enumeration;
+        enumeration.classes.resize(classCount);
+
+        std::vector<multi_sz> lists(classCount);
+        std::atomic<size_t> next{ 0 };
+
+        auto run = [&]
+        {
+            for (auto index = next++; index < classCount; index = next++)
+            {
+                auto & entry = enumeration.classes[index];
+                entry.class_guid = first[index];
+                entry.count = 0;
+
+                auto start = std::chrono::steady_clock::now();
+                auto list = backend.get_device_interface_list(entry.class_guid);
+                entry.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+                entry.result = list.get_result();
+                if (list)
+                {
+                    lists[index] = std::move(list.get());
+                    entry.count = static_cast<size_t>(std::distance(lists[index].begin(), lists[index].end()));
+                }
+            }
+        };
+
+        unsigned threadCount = options.thread_count ? options.thread_count : std::max(1u, std::thread::hardware_concurrency());
+        if (threadCount > classCount) threadCount = static_cast<unsigned>(std::max<size_t>(1, classCount));
+
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        for (unsigned i = 1; i < threadCount; i++)
+        {
+            threads.emplace_back(run);
+        }
+
+        run();
+
+        for (auto & t : threads)
+        {
+            t.join();
+        }
+
+        // merge by pointer into the per-class buffers, then copy each survivor once
+        std::vector<wchar_t const *> merged;
+        size_t total = 0;
+        for (auto const & entry : enumeration.classes) total += entry.count;
+        merged.reserve(total);
+
+        for (auto const & list : lists)
+        {
+            merged.insert(merged.end(), list.begin(), list.end());
+        }
+
+        auto compare = [](wchar_t const * a, wchar_t const * b)
+        {
+            return ::CompareStringOrdinal(a, -1, b, -1, TRUE);
+        };
+
+        // stable, so of entries equal but for case the one from the earliest class survives
+        std::stable_sort(merged.begin(), merged.end(), [&compare](wchar_t const * a, wchar_t const * b) { return compare(a, b) == CSTR_LESS_THAN; });
+        merged.erase(std::unique(merged.begin(), merged.end(), [&compare](wchar_t const * a, wchar_t const * b) { return compare(a, b) == CSTR_EQUAL; }), merged.end());
+
+        std::vector<wchar_t> buffer;
+        for (auto str : merged)
+        {
+            buffer.insert(buffer.end(), str, str + wcslen(str) + 1);
+        }
+
+        buffer.push_back(L'\0');
+        enumeration.entries = multi_sz(std::move(buffer));
+
+        return configret_t<device_enumeration>::success(std::move(enumeration));
+    }
+
+    template<typename GuidIt>
+    configret_t<device_enumeration> parallel_enumerate(GuidIt first, GuidIt last, enumerate_options const & options = enumerate_options())
+    {
+        cm_interface_backend backend;
+        return parallel_enumerate(backend, first, last, options);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "event.h"
+#include "file.h"
+#include "result.h"
+
+namespace wtl
+{
+    struct scan_chunk
+    {
+        std::uint64_t offset;
+        std::uint8_t const * data;
+        size_t size;
+    };
+
+    struct scan_options
+    {
+        // Nominal chunk size; rounded up to a multiple of 64KiB.
+        DWORD chunk_size = 4 * 1024 * 1024;
+
+        // 0 uses std::thread::hardware_concurrency().
+        unsigned thread_count = 0;
+
+        // When set (0-255), chunks are widened or narrowed so that each one holds only whole
+        // records terminated by this byte. Every record is delivered to exactly one chunk; the
+        // final record does not need a terminator.
+        int delimiter = -1;
+
+        // How far past its nominal end a chunk may read to finish its last record. A longer
+        // record fails the scan with ERROR_INSUFFICIENT_BUFFER.
+        DWORD max_record_size = 64 * 1024;
+    };
+
+    namespace details
+    {
+        // A worker's share of the chunk indices. The owner takes from the front; idle workers
+        // steal the back half.
+        struct scan_queue
+        {
+            std::mutex lock;
+            std::uint64_t next = 0;
+            std::uint64_t end = 0;
+
+            bool pop(std::uint64_t & index)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (next == end) return false;
+
+                index = next++;
+                return true;
+            }
+
+            bool steal_from(scan_queue & victim)
+            {
+                std::uint64_t first, last;
+                {
+                    std::lock_guard<std::mutex> guard(victim.lock);
+                    auto remaining = victim.end - victim.next;
+                    if (remaining < 2) return false;
+
+                    last = victim.end;
+                    first = last - remaining / 2;
+                    victim.end = first;
+                }
+
+                std::lock_guard<std::mutex> guard(lock);
+                next = first;
+                end = last;
+
+                return true;
+            }
+        };
+
+        struct scan_worker
+        {
+            file f;
+            event completion;
+            std::vector<std::uint8_t> buffer;
+
+            win32_err read_at(std::uint64_t offset, DWORD length, DWORD & bytesRead)
+            {
+                auto ol = overlapped::at(offset, completion.get());
+
+                if (!::ReadFile(f.get(), buffer.data(), length, nullptr, ol.get()))
+                {
+                    auto err = GetLastError();
+                    if (err == ERROR_HANDLE_EOF)
+                    {
+                        bytesRead = 0;
+                        return ERROR_SUCCESS;
+                    }
+
+                    if (err != ERROR_IO_PENDING) return err;
+                }
+
+                if (!::GetOverlappedResult(f.get(), ol.get(), &bytesRead, TRUE))
+                {
+                    auto err = GetLastError();
+                    if (err != ERROR_HANDLE_EOF) return err;
+
+                    bytesRead = 0;
+                }
+
+                return ERROR_SUCCESS;
+            }
+        };
+
+        inline std::uint8_t const * find_byte(std::uint8_t const * begin, std::uint8_t const * end, std::uint8_t value)
+        {
+            auto found = static_cast<std::uint8_t const *>(std::memchr(begin, value, end - begin));
+            return found ? found : end;
+        }
+    }
+
+    // Reads the file in parallel with positional reads, one private overlapped handle per worker,
+    // and calls callback(scan_chunk const &) for each chunk. The callback runs concurrently on the
+    // worker threads and in no particular order; returning false stops the scan with
+    // ERROR_CANCELLED.
+    //
+    // The worker handles come from ReOpenFile, so 'f' must have been opened with FILE_SHARE_READ;
+    // otherwise the scan fails with ERROR_SHARING_VIOLATION before reading anything.
+    template<typename Callback>
+    win32_err parallel_file_scan(file const & f, Callback&& callback, scan_options options = scan_options())
+    {
+        const DWORD granularity = 64 * 1024;
+        const std::uint64_t chunkSize = (static_cast<std::uint64_t>(options.chunk_size) + granularity - 1) / granularity * granularity;
+        if (chunkSize == 0 || chunkSize > MAXDWORD / 2) return ERROR_INVALID_PARAMETER;
+        if (options.delimiter > 0xFF) return ERROR_INVALID_PARAMETER;
+
+        const bool delimited = options.delimiter >= 0;
+        const auto delimiter = static_cast<std::uint8_t>(options.delimiter);
+        const DWORD overlap = delimited ? options.max_record_size : 0;
+
+        // a worker reads the chunk, the overlap and one byte before it in one ReadFile
+        if (chunkSize + overlap + 1 > MAXDWORD) return ERROR_INVALID_PARAMETER;
+
+        LARGE_INTEGER fileSize;
+        if (!::GetFileSizeEx(f.get(), &fileSize)) return GetLastError();
+
+        const auto size = static_cast<std::uint64_t>(fileSize.QuadPart);
+        if (size == 0) return ERROR_SUCCESS;
+
+        const auto chunkCount = (size + chunkSize - 1) / chunkSize;
+
+        auto threadCount = options.thread_count ? options.thread_count : std::max(1u, std::thread::hardware_concurrency());
+        if (threadCount > chunkCount) threadCount = static_cast<unsigned>(chunkCount);
+
+        std::unique_ptr<details::scan_queue[]> queues(new details::scan_queue[threadCount]);
+        std::vector<details::scan_worker> workers(threadCount);
+
+        for (unsigned i = 0; i < threadCount; i++)
+        {
+            queues[i].next = chunkCount * i / threadCount;
+            queues[i].end = chunkCount * (i + 1) / threadCount;
+
+            // synchronous handles serialize I/O, so each worker gets its own overlapped handle
+            auto & worker = workers[i];
+            worker.f = file(::ReOpenFile(f.get(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, FILE_FLAG_OVERLAPPED));
+            if (!worker.f) return GetLastError();
+
+            RETURN_OR_UNWRAP(completion, event::create(false, true));
+            worker.completion = std::move(completion);
+
+            // one byte before the chunk to find where its first record starts
+            worker.buffer.resize(static_cast<size_t>(chunkSize) + overlap + 1);
+        }
+
+        std::atomic<DWORD> error{ ERROR_SUCCESS };
+
+        auto fail = [&error](DWORD err)
+        {
+            DWORD expected = ERROR_SUCCESS;
+            error.compare_exchange_strong(expected, err);
+        };
+
+        auto process = [&](details::scan_worker & worker, std::uint64_t index) -> bool
+        {
+            const auto nominalBegin = index * chunkSize;
+            const auto nominalEnd = std::min(size, nominalBegin + chunkSize);
+
+            const auto readBegin = (delimited && nominalBegin != 0) ? nominalBegin - 1 : nominalBegin;
+            const auto readEnd = std::min(size, nominalEnd + overlap);
+
+            DWORD bytesRead = 0;
+            auto result = worker.read_at(readBegin, static_cast<DWORD>(readEnd - readBegin), bytesRead);
+            if (!result)
+            {
+                fail(result.get_result());
+                return false;
+            }
+
+            std::uint8_t const * data = worker.buffer.data();
+            auto first = data + (nominalBegin - readBegin);
+            auto last = data + (nominalEnd - readBegin);
+            auto available = data + bytesRead;
+
+            // the file may have shrunk since its size was taken
+            const bool truncated = bytesRead < readEnd - readBegin;
+            if (last > available) last = available;
+            if (first >= last) return true;
+
+            if (delimited)
+            {
+                // a record belongs to the chunk it starts in
+                if (nominalBegin != 0 && data[0] != delimiter)
+                {
+                    first = details::find_byte(first, last, delimiter);
+                    if (first != last) first++;
+
+                    // the chunk is entirely inside a record that started earlier
+                    if (first == last) return true;
+                }
+
+                if (last[-1] != delimiter && nominalEnd != size)
+                {
+                    auto terminator = details::find_byte(last, available, delimiter);
+                    if (terminator == available)
+                    {
+                        if (readEnd != size && !truncated)
+                        {
+                            fail(ERROR_INSUFFICIENT_BUFFER);
+                            return false;
+                        }
+
+                        last = available;
+                    }
+                    else
+                    {
+                        last = terminator + 1;
+                    }
+                }
+            }
+
+            if (first == last) return true;
+
+            scan_chunk chunk = { readBegin + (first - data), first, static_cast<size_t>(last - first) };
+            if (!callback(chunk))
+            {
+                fail(ERROR_CANCELLED);
+                return false;
+            }
+
+            return true;
+        };
+
+        auto run = [&](unsigned self)
+        {
+            auto & queue = queues[self];
+            auto & worker = workers[self];
+
+            for (;;)
+            {
+                if (error != ERROR_SUCCESS) return;
+
+                std::uint64_t index;
+                if (queue.pop(index))
+                {
+                    if (!process(worker, index)) return;
+                    continue;
+                }
+
+                bool stole = false;
+                for (unsigned i = 1; i < threadCount && !stole; i++)
+                {
+                    stole = queue.steal_from(queues[(self + i) % threadCount]);
+                }
+
+                if (!stole) return;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        for (unsigned i = 1; i < threadCount; i++)
+        {
+            threads.emplace_back(run, i);
+        }
+
+        run(0);
+
+        for (auto & t : threads)
+        {
+            t.join();
+        }
+
+        return error.load();
+    }
+}
\ No newline at end of file
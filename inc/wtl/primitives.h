@@ -7,4 +7,32 @@ namespace wtl
 {
     using dword_milliseconds = std::chrono::duration<std::uint32_t, std::milli>;
     constexpr auto infinite = dword_milliseconds(INFINITE);
+
+    // Absolute point in time for waits. One deadline can bound a whole chain of waits, and it
+    // carries the clock's full precision instead of whole milliseconds.
+    using deadline = std::chrono::steady_clock::time_point;
+    constexpr auto no_deadline = deadline::max();
+
+    template<typename Rep, typename Period>
+    deadline deadline_after(std::chrono::duration<Rep, Period> timeout)
+    {
+        return std::chrono::steady_clock::now() + std::chrono::duration_cast<deadline::duration>(timeout);
+    }
+
+    // Whole milliseconds left until the deadline, rounded up so a wait never returns early.
+    // Deadlines beyond the 32-bit range are clamped to just under infinite; callers that need
+    // to honour them loop until the deadline has actually passed.
+    inline dword_milliseconds remaining_milliseconds(deadline until)
+    {
+        if (until == no_deadline) return infinite;
+
+        auto now = std::chrono::steady_clock::now();
+        if (until <= now) return dword_milliseconds(0);
+
+        auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(until - now).count();
+        auto milliseconds = (left + 999999) / 1000000;
+        if (milliseconds >= INFINITE) return dword_milliseconds(INFINITE - 1);
+
+        return dword_milliseconds(static_cast<std::uint32_t>(milliseconds));
+    }
 }
\ No newline at end of file
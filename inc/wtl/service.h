@@ -1,9 +1,56 @@
 #pragma once
 
-#include "resource_handle.h"
+#include <windows.h>
 #include <winsvc.h>
 
+#include "resource_handle.h"
+#include "result.h"
+
 namespace wtl
 {
     using sc_handle = resource_handle<SC_HANDLE, int, 0, decltype(::CloseServiceHandle), ::CloseServiceHandle>;
+
+    namespace service
+    {
+        // One service control manager handle for the whole process, opened on first use with
+        // connect and enumerate access. Do not close it.
+        inline win32_err_t<SC_HANDLE> shared_scm()
+        {
+            static struct holder
+            {
+                sc_handle scm;
+                DWORD error;
+
+                holder() :
+                    scm(::OpenSCManagerW(nullptr, nullptr, SC_MANAGER_CONNECT | SC_MANAGER_ENUMERATE_SERVICE)),
+                    error(scm ? ERROR_SUCCESS : GetLastError())
+                {
+
+                }
+            } instance;
+
+            if (!instance.scm) return instance.error;
+
+            return win32_err_t<SC_HANDLE>::success(instance.scm.get());
+        }
+
+        inline win32_err_t<sc_handle> open(PCWSTR serviceName, DWORD desiredAccess)
+        {
+            RETURN_OR_UNWRAP(scm, shared_scm());
+
+            sc_handle service = ::OpenServiceW(scm, serviceName, desiredAccess);
+            if (!service) return GetLastError();
+
+            return win32_err_t<sc_handle>::success(std::move(service));
+        }
+
+        inline win32_err_t<SERVICE_STATUS_PROCESS> query_status(SC_HANDLE service)
+        {
+            SERVICE_STATUS_PROCESS status;
+            DWORD needed;
+            if (!::QueryServiceStatusEx(service, SC_STATUS_PROCESS_INFO, reinterpret_cast<LPBYTE>(&status), sizeof(status), &needed)) return GetLastError();
+
+            return win32_err_t<SERVICE_STATUS_PROCESS>::success(status);
+        }
+    }
 }
\ No newline at end of file
@@ -0,0 +1,666 @@
+#pragma once
+
+#include <windows.h>
+#include <winsvc.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "multi_sz.h"
+#include "primitives.h"
+#include "result.h"
+#include "service.h"
+#include "string_table.h"
+
+namespace wtl
+{
+    // Callbacks a service monitor backend raises from inside its wait().
+    struct service_events
+    {
+        std::function<void(PCWSTR, SERVICE_STATUS_PROCESS const &)> status;
+        std::function<void(PCWSTR)> created;
+        std::function<void(PCWSTR)> deleted;
+    };
+
+    namespace details
+    {
+        // Every state but 'currentState', so arming a notification does not fire at once for the
+        // state we already know about.
+        inline DWORD service_notify_mask(DWORD currentState)
+        {
+            const DWORD all =
+                SERVICE_NOTIFY_STOPPED | SERVICE_NOTIFY_START_PENDING | SERVICE_NOTIFY_STOP_PENDING |
+                SERVICE_NOTIFY_RUNNING | SERVICE_NOTIFY_CONTINUE_PENDING | SERVICE_NOTIFY_PAUSE_PENDING |
+                SERVICE_NOTIFY_PAUSED | SERVICE_NOTIFY_DELETE_PENDING;
+
+            if (currentState < SERVICE_STOPPED || currentState > SERVICE_PAUSED) return all;
+
+            return all & ~(DWORD(1) << (currentState - 1));
+        }
+    }
+
+    // Service monitor backend on the service control manager. Notifications arrive as APCs
+    // from NotifyServiceStatusChange, so every call, wait() in particular, must come from the
+    // same thread.
+    class scm_backend
+    {
+        struct state;
+
+        struct watch
+        {
+            state * owner;
+            std::wstring name;
+            sc_handle service;
+            SERVICE_NOTIFYW notify;
+            DWORD knownState;
+            bool armed;
+            bool closed = false;
+        };
+
+        struct state
+        {
+            service_events events;
+            sc_handle scm;
+            SERVICE_NOTIFYW scmNotify;
+            bool scmArmed = false;
+            std::map<std::wstring, std::unique_ptr<watch>> watches;
+            std::vector<watch *> fired;
+
+            // closed watches whose notification block may still be referenced by a queued APC;
+            // freed by the next wait() once the queue has been drained
+            std::vector<std::unique_ptr<watch>> retired;
+
+            ~state()
+            {
+                // stop calling out, close every handle, then let notifications already queued to
+                // this thread run against live objects
+                events = service_events();
+                scm.reset(nullptr);
+
+                for (auto & entry : watches)
+                {
+                    entry.second->service.reset(nullptr);
+                }
+
+                while (::SleepEx(0, TRUE) == WAIT_IO_COMPLETION);
+            }
+
+            void retire(std::unique_ptr<watch>&& w)
+            {
+                fired.erase(std::remove(fired.begin(), fired.end(), w.get()), fired.end());
+
+                w->closed = true;
+                w->service.reset(nullptr);
+                retired.push_back(std::move(w));
+            }
+        };
+
+        std::unique_ptr<state> m_state;
+
+        static void CALLBACK on_service_notify(PVOID parameter)
+        {
+            auto notify = static_cast<PSERVICE_NOTIFYW>(parameter);
+            auto w = static_cast<watch *>(notify->pContext);
+
+            w->armed = false;
+            if (w->closed) return;
+
+            w->owner->fired.push_back(w);
+
+            if (notify->dwNotificationStatus == ERROR_SUCCESS && w->owner->events.status)
+            {
+                w->knownState = notify->ServiceStatus.dwCurrentState;
+                w->owner->events.status(w->name.c_str(), notify->ServiceStatus);
+            }
+        }
+
+        static void CALLBACK on_scm_notify(PVOID parameter)
+        {
+            auto notify = static_cast<PSERVICE_NOTIFYW>(parameter);
+            auto s = static_cast<state *>(notify->pContext);
+
+            s->scmArmed = false;
+
+            if (notify->dwNotificationStatus == ERROR_SUCCESS && notify->pszServiceNames)
+            {
+                // created services are prefixed with '/'
+                for (auto name : multi_sz_view(notify->pszServiceNames))
+                {
+                    if (name[0] == L'/')
+                    {
+                        if (s->events.created) s->events.created(name + 1);
+                    }
+                    else if (s->events.deleted)
+                    {
+                        s->events.deleted(name);
+                    }
+                }
+            }
+
+            if (notify->pszServiceNames)
+            {
+                ::LocalFree(notify->pszServiceNames);
+                notify->pszServiceNames = nullptr;
+            }
+        }
+
+        static void arm(watch & w)
+        {
+            w.notify = {};
+            w.notify.dwVersion = SERVICE_NOTIFY_STATUS_CHANGE;
+            w.notify.pfnNotifyCallback = on_service_notify;
+            w.notify.pContext = &w;
+
+            w.armed = ::NotifyServiceStatusChangeW(w.service.get(), details::service_notify_mask(w.knownState), &w.notify) == ERROR_SUCCESS;
+        }
+
+        void arm_scm()
+        {
+            auto & notify = m_state->scmNotify;
+            notify = {};
+            notify.dwVersion = SERVICE_NOTIFY_STATUS_CHANGE;
+            notify.pfnNotifyCallback = on_scm_notify;
+            notify.pContext = m_state.get();
+
+            m_state->scmArmed = ::NotifyServiceStatusChangeW(m_state->scm.get(), SERVICE_NOTIFY_CREATED | SERVICE_NOTIFY_DELETED, &notify) == ERROR_SUCCESS;
+        }
+
+    public:
+        scm_backend() : m_state(new state()) { }
+
+        scm_backend(scm_backend&& other) = default;
+        scm_backend & operator=(scm_backend&& other) = default;
+
+        template<typename Callback>
+        win32_err enumerate(DWORD serviceType, Callback&& callback)
+        {
+            RETURN_OR_UNWRAP(scm, service::shared_scm());
+
+            std::vector<BYTE> buffer(64 * 1024);
+            DWORD resume = 0;
+
+            for (;;)
+            {
+                DWORD needed = 0, count = 0;
+                auto ok = ::EnumServicesStatusExW(scm, SC_ENUM_PROCESS_INFO, serviceType, SERVICE_STATE_ALL, buffer.data(), static_cast<DWORD>(buffer.size()), &needed, &count, &resume, nullptr);
+                auto err = ok ? ERROR_SUCCESS : GetLastError();
+                if (!ok && err != ERROR_MORE_DATA) return err;
+
+                auto services = reinterpret_cast<ENUM_SERVICE_STATUS_PROCESSW const *>(buffer.data());
+                for (DWORD i = 0; i < count; i++)
+                {
+                    callback(services[i].lpServiceName, services[i].ServiceStatusProcess);
+                }
+
+                if (ok) return ERROR_SUCCESS;
+
+                if (count == 0)
+                {
+                    buffer.resize(std::max<size_t>(buffer.size() * 2, needed));
+                }
+            }
+        }
+
+        // Creation and deletion are watched through an SCM handle of the backend's own, since
+        // only one notification can be outstanding on a handle.
+        win32_err start(service_events events)
+        {
+            m_state->events = std::move(events);
+
+            m_state->scm = sc_handle(::OpenSCManagerW(nullptr, nullptr, SC_MANAGER_ENUMERATE_SERVICE));
+            if (!m_state->scm) return GetLastError();
+
+            arm_scm();
+
+            return ERROR_SUCCESS;
+        }
+
+        win32_err watch_service(PCWSTR name, DWORD knownState)
+        {
+            RETURN_OR_UNWRAP(opened, service::open(name, SERVICE_QUERY_STATUS));
+
+            std::unique_ptr<watch> w(new watch());
+            w->owner = m_state.get();
+            w->name = name;
+            w->service = std::move(opened);
+            w->knownState = knownState;
+
+            arm(*w);
+
+            auto & slot = m_state->watches[name];
+            if (slot) m_state->retire(std::move(slot));
+            slot = std::move(w);
+
+            return ERROR_SUCCESS;
+        }
+
+        void unwatch_service(PCWSTR name)
+        {
+            auto found = m_state->watches.find(name);
+            if (found == m_state->watches.end()) return;
+
+            m_state->retire(std::move(found->second));
+            m_state->watches.erase(found);
+        }
+
+        // Runs queued notifications, waiting up to 'timeout' for the first, then re-arms every
+        // watch that fired.
+        win32_err wait(dword_milliseconds timeout)
+        {
+            ::SleepEx(timeout.count(), TRUE);
+
+            // pick up anything else already queued
+            while (::SleepEx(0, TRUE) == WAIT_IO_COMPLETION);
+
+            for (auto w : m_state->fired)
+            {
+                if (!w->armed) arm(*w);
+            }
+
+            m_state->fired.clear();
+
+            // no new notification is queued for a closed handle, and the ones queued before it
+            // was closed have all run above
+            m_state->retired.clear();
+
+            if (m_state->scm && !m_state->scmArmed) arm_scm();
+
+            return ERROR_SUCCESS;
+        }
+    };
+
+    namespace details
+    {
+        struct fake_scm_event
+        {
+            int kind;
+            std::wstring name;
+            SERVICE_STATUS_PROCESS status;
+        };
+
+        struct fake_scm_state
+        {
+            std::mutex lock;
+            std::condition_variable changed;
+            std::map<std::wstring, SERVICE_STATUS_PROCESS> services;
+            std::map<std::wstring, DWORD> watched;
+            std::deque<fake_scm_event> queue;
+            bool started = false;
+            size_t enumerateCalls = 0;
+        };
+    }
+
+    // In-process stand-in for the service control manager with the same surface as scm_backend.
+    // Copies share one service table. Changes made through it are queued and delivered by the
+    // next wait(), from any thread, the way notification APCs are.
+    class fake_scm
+    {
+        enum { event_status, event_created, event_deleted };
+
+        std::shared_ptr<details::fake_scm_state> m_state;
+        service_events m_events;
+
+        static SERVICE_STATUS_PROCESS make_status(DWORD currentState, DWORD processId)
+        {
+            SERVICE_STATUS_PROCESS status = {};
+            status.dwServiceType = SERVICE_WIN32_OWN_PROCESS;
+            status.dwCurrentState = currentState;
+            status.dwProcessId = processId;
+
+            return status;
+        }
+
+        void push(int kind, std::wstring const & name, SERVICE_STATUS_PROCESS const & status)
+        {
+            details::fake_scm_event e = { kind, name, status };
+            m_state->queue.push_back(std::move(e));
+            m_state->changed.notify_all();
+        }
+
+    public:
+        fake_scm() : m_state(std::make_shared<details::fake_scm_state>()) { }
+
+        void add_service(std::wstring const & name, DWORD currentState = SERVICE_STOPPED, DWORD processId = 0)
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            m_state->services[name] = make_status(currentState, processId);
+
+            if (m_state->started) push(event_created, name, m_state->services[name]);
+        }
+
+        void remove_service(std::wstring const & name)
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            m_state->services.erase(name);
+
+            if (m_state->started) push(event_deleted, name, make_status(0, 0));
+        }
+
+        void set_state(std::wstring const & name, DWORD currentState, DWORD processId = 0)
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            auto & status = m_state->services[name];
+            status = make_status(currentState, processId);
+
+            if (m_state->watched.count(name)) push(event_status, name, status);
+        }
+
+        size_t enumerate_calls() const
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            return m_state->enumerateCalls;
+        }
+
+        template<typename Callback>
+        win32_err enumerate(DWORD, Callback&& callback)
+        {
+            std::vector<std::pair<std::wstring, SERVICE_STATUS_PROCESS>> services;
+            {
+                std::lock_guard<std::mutex> guard(m_state->lock);
+                m_state->enumerateCalls++;
+                services.assign(m_state->services.begin(), m_state->services.end());
+            }
+
+            for (auto const & service : services)
+            {
+                callback(service.first.c_str(), service.second);
+            }
+
+            return ERROR_SUCCESS;
+        }
+
+        win32_err start(service_events events)
+        {
+            m_events = std::move(events);
+
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            m_state->started = true;
+
+            return ERROR_SUCCESS;
+        }
+
+        win32_err watch_service(PCWSTR name, DWORD knownState)
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+
+            auto found = m_state->services.find(name);
+            if (found == m_state->services.end()) return ERROR_SERVICE_DOES_NOT_EXIST;
+
+            m_state->watched[name] = knownState;
+
+            // like NotifyServiceStatusChange, report at once if the state already moved on
+            if (found->second.dwCurrentState != knownState) push(event_status, name, found->second);
+
+            return ERROR_SUCCESS;
+        }
+
+        void unwatch_service(PCWSTR name)
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            m_state->watched.erase(name);
+        }
+
+        win32_err wait(dword_milliseconds timeout)
+        {
+            std::deque<details::fake_scm_event> events;
+            {
+                std::unique_lock<std::mutex> guard(m_state->lock);
+
+                auto ready = [this] { return !m_state->queue.empty(); };
+                if (timeout == infinite) m_state->changed.wait(guard, ready);
+                else m_state->changed.wait_for(guard, timeout, ready);
+
+                events.swap(m_state->queue);
+            }
+
+            for (auto const & e : events)
+            {
+                switch (e.kind)
+                {
+                case event_status: m_events.status(e.name.c_str(), e.status); break;
+                case event_created: m_events.created(e.name.c_str()); break;
+                case event_deleted: m_events.deleted(e.name.c_str()); break;
+                }
+            }
+
+            return ERROR_SUCCESS;
+        }
+    };
+
+    enum class service_change_kind
+    {
+        state_changed,
+        created,
+        deleted
+    };
+
+    struct service_change
+    {
+        service_change_kind kind;
+        string_table::id_type service;
+
+        // The state callers last saw in a delta or the snapshot; 0 for created services.
+        DWORD previous_state;
+        SERVICE_STATUS_PROCESS status;
+    };
+
+    // Keeps a table of every service's status, built from one enumeration and then kept up to
+    // date from change notifications instead of polling. Service names are interned; use
+    // name() and find() to go between names and IDs.
+    //
+    // wait() delivers only deltas: notifications that arrive in the same wait are coalesced per
+    // service, and a service that left a state and came back to it is not reported. Deletion and
+    // creation are never merged with each other, so a service deleted and re-created in one wait
+    // is reported as both. Not thread safe; with scm_backend every call must come from the thread
+    // that created the monitor.
+    template<typename Backend>
+    class basic_service_monitor
+    {
+        struct state
+        {
+            Backend backend;
+            string_table names;
+            std::vector<SERVICE_STATUS_PROCESS> statuses;
+            std::vector<bool> present;
+            std::vector<service_change> pending;
+            std::vector<size_t> pendingIndex;
+
+            explicit state(Backend&& backend) : backend(std::move(backend)) { }
+
+            string_table::id_type track(PCWSTR name)
+            {
+                auto id = names.intern(name);
+                if (id != string_table::npos && id >= statuses.size())
+                {
+                    statuses.resize(id + 1, SERVICE_STATUS_PROCESS());
+                    present.resize(id + 1, false);
+                    pendingIndex.resize(id + 1, SIZE_MAX);
+                }
+
+                return id;
+            }
+
+            service_change & pending_for(string_table::id_type id, service_change_kind kind)
+            {
+                auto & index = pendingIndex[id];
+
+                // status changes merge into whatever is pending, and a deletion absorbs status
+                // changes before it, but a creation and a deletion are both delivered in order
+                auto flips = index != SIZE_MAX &&
+                    kind != service_change_kind::state_changed &&
+                    pending[index].kind != service_change_kind::state_changed &&
+                    pending[index].kind != kind;
+
+                if (index == SIZE_MAX || flips)
+                {
+                    index = pending.size();
+                    service_change change = { kind, id, statuses[id].dwCurrentState, statuses[id] };
+                    pending.push_back(change);
+                }
+
+                return pending[index];
+            }
+
+            void on_status(PCWSTR name, SERVICE_STATUS_PROCESS const & status)
+            {
+                auto id = names.find(name);
+                if (id == string_table::npos || !present[id]) return;
+
+                pending_for(id, service_change_kind::state_changed).status = status;
+            }
+
+            void on_created(PCWSTR name)
+            {
+                // a creation racing with the snapshot is already known
+                auto id = track(name);
+                if (id == string_table::npos || present[id]) return;
+
+                auto & change = pending_for(id, service_change_kind::created);
+                change.kind = service_change_kind::created;
+                change.previous_state = 0;
+                change.status = SERVICE_STATUS_PROCESS();
+
+                present[id] = true;
+                statuses[id] = SERVICE_STATUS_PROCESS();
+                backend.watch_service(name, 0);
+            }
+
+            void on_deleted(PCWSTR name)
+            {
+                auto id = names.find(name);
+                if (id == string_table::npos || !present[id]) return;
+
+                pending_for(id, service_change_kind::deleted).kind = service_change_kind::deleted;
+
+                present[id] = false;
+                backend.unwatch_service(name);
+            }
+        };
+
+        std::unique_ptr<state> m_state;
+
+        explicit basic_service_monitor(std::unique_ptr<state>&& s) : m_state(std::move(s)) { }
+
+    public:
+        basic_service_monitor(basic_service_monitor&& other) = default;
+        basic_service_monitor & operator=(basic_service_monitor&& other) = default;
+
+        static win32_err_t<basic_service_monitor> create(Backend backend = Backend(), DWORD serviceType = SERVICE_WIN32)
+        {
+            std::unique_ptr<state> s(new (std::nothrow) state(std::move(backend)));
+            if (!s) return ERROR_NOT_ENOUGH_MEMORY;
+
+            auto raw = s.get();
+
+            service_events events;
+            events.status = [raw](PCWSTR name, SERVICE_STATUS_PROCESS const & status) { raw->on_status(name, status); };
+            events.created = [raw](PCWSTR name) { raw->on_created(name); };
+            events.deleted = [raw](PCWSTR name) { raw->on_deleted(name); };
+
+            // subscribe to creation first so nothing slips in between the snapshot and the watches
+            auto started = s->backend.start(std::move(events));
+            if (!started) return started.get_result();
+
+            auto enumerated = s->backend.enumerate(serviceType, [raw](PCWSTR name, SERVICE_STATUS_PROCESS const & status)
+            {
+                auto id = raw->track(name);
+                if (id == string_table::npos) return;
+
+                raw->statuses[id] = status;
+                raw->present[id] = true;
+            });
+            if (!enumerated) return enumerated.get_result();
+
+            for (string_table::id_type id = 0; id < s->statuses.size(); id++)
+            {
+                // services that cannot be opened for status are in the snapshot but not watched
+                s->backend.watch_service(s->names.str(id).c_str(), s->statuses[id].dwCurrentState);
+            }
+
+            // the snapshot is the baseline; notifications racing with it are not deltas
+            s->pending.clear();
+            std::fill(s->pendingIndex.begin(), s->pendingIndex.end(), SIZE_MAX);
+
+            return win32_err_t<basic_service_monitor>::success(basic_service_monitor(std::move(s)));
+        }
+
+        // Waits up to 'timeout' for notifications and calls callback(std::vector<service_change>
+        // const &) once with the resulting deltas, if there are any. Returns the number of deltas.
+        template<typename Callback>
+        win32_err_t<size_t> wait(Callback&& callback, dword_milliseconds timeout = infinite)
+        {
+            auto waited = m_state->backend.wait(timeout);
+            if (!waited) return waited.get_result();
+
+            auto & pending = m_state->pending;
+            std::vector<service_change> changes;
+            changes.reserve(pending.size());
+
+            for (auto & change : pending)
+            {
+                m_state->pendingIndex[change.service] = SIZE_MAX;
+
+                auto & known = m_state->statuses[change.service];
+
+                if (change.kind == service_change_kind::state_changed &&
+                    change.status.dwCurrentState == known.dwCurrentState &&
+                    change.status.dwProcessId == known.dwProcessId)
+                {
+                    continue;
+                }
+
+                if (change.kind != service_change_kind::deleted)
+                {
+                    known = change.status;
+                }
+
+                changes.push_back(change);
+            }
+
+            pending.clear();
+
+            if (!changes.empty())
+            {
+                callback(static_cast<std::vector<service_change> const &>(changes));
+            }
+
+            return win32_err_t<size_t>::success(changes.size());
+        }
+
+        size_t size() const
+        {
+            return m_state->statuses.size();
+        }
+
+        bool present(string_table::id_type id) const
+        {
+            return m_state->present[id];
+        }
+
+        SERVICE_STATUS_PROCESS const & status(string_table::id_type id) const
+        {
+            return m_state->statuses[id];
+        }
+
+        std::wstring name(string_table::id_type id) const
+        {
+            return m_state->names.str(id);
+        }
+
+        // npos for services the monitor has never seen.
+        string_table::id_type find(PCWSTR name) const
+        {
+            return m_state->names.find(name);
+        }
+    };
+
+    using service_monitor = basic_service_monitor<scm_backend>;
+}
\ No newline at end of file
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <windows.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include "event.h"
+#include "mapped_file.h"
+#include "primitives.h"
+#include "result.h"
+
+namespace wtl
+{
+    namespace details
+    {
+        // Start of the shared section. The two positions live on separate cache lines so the
+        // producer and consumer never write the same line.
+        struct shm_ring_header
+        {
+            static const std::uint32_t signature = 0x474E5257; // "WRNG"
+
+            std::uint32_t magic;
+            std::uint32_t capacity;
+
+            // byte positions; they only grow and are reduced modulo capacity for access
+            alignas(64) std::atomic<std::uint64_t> tail;
+            alignas(64) std::atomic<std::uint64_t> head;
+
+            // set by a consumer about to sleep on the event
+            alignas(64) std::atomic<std::uint32_t> waiting;
+        };
+
+        // Each record is an 8 byte header followed by the payload, padded to 8 bytes. A record
+        // that would straddle the end of the buffer is preceded by a wrap marker instead.
+        const std::uint32_t shm_ring_wrap = 0xFFFFFFFF;
+
+        inline std::uint64_t shm_ring_record_size(std::uint32_t size)
+        {
+            return (8 + static_cast<std::uint64_t>(size) + 7) & ~std::uint64_t(7);
+        }
+
+        inline std::wstring shm_ring_event_name(PCWSTR name)
+        {
+            // sections and events share one namespace
+            return std::wstring(name) + L".signal";
+        }
+
+        class shm_ring_mapping
+        {
+        protected:
+            file_mapping m_section;
+            mapped_view m_view;
+            event m_signal;
+            shm_ring_header * m_header = nullptr;
+            std::uint8_t * m_data = nullptr;
+            std::uint64_t m_mask = 0;
+
+            void attach()
+            {
+                m_header = static_cast<shm_ring_header *>(m_view.get());
+                m_data = static_cast<std::uint8_t *>(m_view.get()) + sizeof(shm_ring_header);
+                m_mask = m_header->capacity - 1;
+            }
+
+        public:
+            std::uint32_t capacity() const
+            {
+                return m_header->capacity;
+            }
+
+            // Largest payload a single record can carry.
+            std::uint32_t max_record_size() const
+            {
+                return m_header->capacity / 2 - 8;
+            }
+        };
+    }
+
+    // Writing end of a shm_ring. Records are staged with try_push() and become visible to the
+    // consumer together on publish(), so a burst of records costs one release store and at most
+    // one SetEvent.
+    class shm_ring_producer : public details::shm_ring_mapping
+    {
+        std::uint64_t m_tail = 0;
+        std::uint64_t m_cachedHead = 0;
+
+    public:
+        shm_ring_producer() { }
+
+        shm_ring_producer(shm_ring_producer&& other) = default;
+        shm_ring_producer & operator=(shm_ring_producer&& other) = default;
+
+        // Creates the named section and its event. capacity is the data size in bytes and must
+        // be a power of two. ERROR_ALREADY_EXISTS if another ring already has the name.
+        static win32_err_t<shm_ring_producer> create(PCWSTR name, std::uint32_t capacity, LPSECURITY_ATTRIBUTES securityAttributes = nullptr)
+        {
+            if (capacity < 64 || (capacity & (capacity - 1)) != 0) return ERROR_INVALID_PARAMETER;
+
+            shm_ring_producer ring;
+
+            auto size = static_cast<std::uint64_t>(sizeof(details::shm_ring_header)) + capacity;
+            ring.m_section = file_mapping(::CreateFileMappingW(INVALID_HANDLE_VALUE, securityAttributes, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), name));
+            if (!ring.m_section) return GetLastError();
+            if (GetLastError() == ERROR_ALREADY_EXISTS) return ERROR_ALREADY_EXISTS;
+
+            ring.m_view = mapped_view(::MapViewOfFile(ring.m_section.get(), FILE_MAP_ALL_ACCESS, 0, 0, 0));
+            if (!ring.m_view) return GetLastError();
+
+            RETURN_OR_UNWRAP(signal, event::create(false, false, details::shm_ring_event_name(name).c_str(), securityAttributes));
+            ring.m_signal = std::move(signal);
+
+            // the section starts zeroed; the header is published last so a consumer that opens
+            // early sees no magic rather than half a header
+            auto header = new (ring.m_view.get()) details::shm_ring_header();
+            header->capacity = capacity;
+            header->tail.store(0);
+            header->head.store(0);
+            header->waiting.store(0);
+            std::atomic_thread_fence(std::memory_order_release);
+            header->magic = details::shm_ring_header::signature;
+
+            ring.attach();
+
+            return win32_err_t<shm_ring_producer>::success(std::move(ring));
+        }
+
+        // Stages a record. False if the ring does not have room for it yet or the record is
+        // larger than max_record_size(). Nothing is visible to the consumer until publish().
+        bool try_push(void const * data, std::uint32_t size)
+        {
+            if (size > max_record_size()) return false;
+
+            auto needed = details::shm_ring_record_size(size);
+            auto offset = m_tail & m_mask;
+            auto contiguous = capacity() - offset;
+            auto padding = needed > contiguous ? contiguous : 0;
+
+            if (m_tail + padding + needed - m_cachedHead > capacity())
+            {
+                m_cachedHead = m_header->head.load(std::memory_order_acquire);
+                if (m_tail + padding + needed - m_cachedHead > capacity()) return false;
+            }
+
+            if (padding != 0)
+            {
+                std::memcpy(m_data + offset, &details::shm_ring_wrap, sizeof(details::shm_ring_wrap));
+                m_tail += padding;
+                offset = 0;
+            }
+
+            std::memcpy(m_data + offset, &size, sizeof(size));
+            std::memcpy(m_data + offset + 8, data, size);
+            m_tail += needed;
+
+            return true;
+        }
+
+        // Makes every staged record visible. Signals the event only if the consumer went to
+        // sleep on an empty ring.
+        win32_err publish()
+        {
+            if (m_tail == m_header->tail.load(std::memory_order_relaxed)) return ERROR_SUCCESS;
+
+            // sequentially consistent, paired with the consumer setting 'waiting' and then
+            // re-reading the tail, so one of the two always sees the other
+            m_header->tail.store(m_tail);
+
+            if (m_header->waiting.load() != 0 && m_header->waiting.exchange(0) != 0)
+            {
+                return m_signal.set();
+            }
+
+            return ERROR_SUCCESS;
+        }
+
+        // try_push() followed by publish(). False if the record was not staged. A failure means
+        // the record was published but the consumer could not be woken; it must not be written
+        // again.
+        win32_err_t<bool> try_write(void const * data, std::uint32_t size)
+        {
+            if (!try_push(data, size)) return win32_err_t<bool>::success(false);
+
+            auto published = publish();
+            if (!published) return published.get_result();
+
+            return win32_err_t<bool>::success(true);
+        }
+    };
+
+    // Reading end of a shm_ring. Records are read in place from the shared section, and the
+    // space they occupy is handed back to the producer once per consume() call.
+    class shm_ring_consumer : public details::shm_ring_mapping
+    {
+        std::uint64_t m_head = 0;
+
+    public:
+        shm_ring_consumer() { }
+
+        shm_ring_consumer(shm_ring_consumer&& other) = default;
+        shm_ring_consumer & operator=(shm_ring_consumer&& other) = default;
+
+        // Opens a ring created by shm_ring_producer::create. ERROR_FILE_NOT_FOUND if there is
+        // none; ERROR_INVALID_DATA if the section is not a ring.
+        static win32_err_t<shm_ring_consumer> open(PCWSTR name)
+        {
+            shm_ring_consumer ring;
+
+            ring.m_section = file_mapping(::OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, name));
+            if (!ring.m_section) return GetLastError();
+
+            ring.m_view = mapped_view(::MapViewOfFile(ring.m_section.get(), FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0));
+            if (!ring.m_view) return GetLastError();
+
+            MEMORY_BASIC_INFORMATION info;
+            if (!::VirtualQuery(ring.m_view.get(), &info, sizeof(info))) return GetLastError();
+            if (info.RegionSize < sizeof(details::shm_ring_header)) return ERROR_INVALID_DATA;
+
+            auto header = static_cast<details::shm_ring_header *>(ring.m_view.get());
+            if (header->magic != details::shm_ring_header::signature) return ERROR_INVALID_DATA;
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            auto capacity = header->capacity;
+            if (capacity < 64 || (capacity & (capacity - 1)) != 0 || info.RegionSize - sizeof(details::shm_ring_header) < capacity) return ERROR_INVALID_DATA;
+
+            ring.m_signal = event(::OpenEventW(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE, details::shm_ring_event_name(name).c_str()));
+            if (!ring.m_signal) return GetLastError();
+
+            ring.attach();
+            ring.m_head = header->head.load(std::memory_order_acquire);
+
+            return win32_err_t<shm_ring_consumer>::success(std::move(ring));
+        }
+
+        bool empty() const
+        {
+            return m_header->tail.load(std::memory_order_acquire) == m_head;
+        }
+
+        // Calls callback(void const * data, std::uint32_t size) for up to maxRecords published
+        // records, in order. The data points into the ring and is only valid during the call.
+        // ERROR_INVALID_DATA if the producer wrote a malformed record.
+        template<typename Callback>
+        win32_err_t<size_t> consume(Callback&& callback, size_t maxRecords = SIZE_MAX)
+        {
+            auto tail = m_header->tail.load(std::memory_order_acquire);
+            auto start = m_head;
+            size_t count = 0;
+            DWORD err = ERROR_SUCCESS;
+
+            while (m_head != tail && count < maxRecords)
+            {
+                auto offset = m_head & m_mask;
+
+                std::uint32_t size;
+                std::memcpy(&size, m_data + offset, sizeof(size));
+
+                if (size == details::shm_ring_wrap)
+                {
+                    m_head += capacity() - offset;
+                    continue;
+                }
+
+                auto recordSize = details::shm_ring_record_size(size);
+                if (recordSize > capacity() - offset || recordSize > tail - m_head)
+                {
+                    err = ERROR_INVALID_DATA;
+                    break;
+                }
+
+                callback(static_cast<void const *>(m_data + offset + 8), size);
+                m_head += recordSize;
+                count++;
+            }
+
+            if (m_head != start)
+            {
+                m_header->head.store(m_head, std::memory_order_release);
+            }
+
+            if (err != ERROR_SUCCESS) return err;
+
+            return win32_err_t<size_t>::success(count);
+        }
+
+        // Blocks until the ring has published records. Returns wait_result::timeout if the
+        // deadline passes first.
+        win32_err_t<wait_result> wait(deadline until = no_deadline)
+        {
+            for (;;)
+            {
+                if (!empty()) return win32_err_t<wait_result>::success(wait_result::signaled);
+
+                // both sequentially consistent; see shm_ring_producer::publish
+                m_header->waiting.store(1);
+                if (m_header->tail.load() != m_head)
+                {
+                    m_header->waiting.store(0);
+                    return win32_err_t<wait_result>::success(wait_result::signaled);
+                }
+
+                RETURN_OR_UNWRAP(result, m_signal.wait(until));
+                if (result == wait_result::timeout)
+                {
+                    m_header->waiting.store(0);
+                    return win32_err_t<wait_result>::success(empty() ? wait_result::timeout : wait_result::signaled);
+                }
+
+                // a signal left over from an earlier wait can wake us on a ring that is still
+                // empty; go around again
+            }
+        }
+
+        win32_err_t<wait_result> wait(dword_milliseconds timeout)
+        {
+            return wait(timeout == infinite ? no_deadline : deadline_after(timeout));
+        }
+    };
+}
\ No newline at end of file
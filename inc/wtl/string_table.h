@@ -0,0 +1,279 @@
+#pragma once
+
+#include <cstdint>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+#include "multi_sz.h"
+
+namespace wtl
+{
+    namespace details
+    {
+        inline std::uint32_t hash_chars(wchar_t const * str, size_t length, std::uint32_t hash = 2166136261u)
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                hash = (hash ^ static_cast<std::uint32_t>(str[i])) * 16777619u;
+            }
+
+            return hash;
+        }
+
+        // Length of the enumerator and device ID part of a device path, separators included:
+        // "\\?\USB#VID_0001&PID_0001#" for interface paths, "USB\VID_0001&PID_0001\" for instance
+        // IDs. Zero if the string has fewer than two separators.
+        inline size_t device_path_prefix_length(wchar_t const * str, size_t length)
+        {
+            size_t i = 0;
+            if (length >= 4 && str[0] == L'\\' && str[1] == L'\\' && (str[2] == L'?' || str[2] == L'.') && str[3] == L'\\')
+            {
+                i = 4;
+            }
+
+            unsigned separators = 0;
+            for (; i < length; i++)
+            {
+                if (str[i] == L'#' || str[i] == L'\\')
+                {
+                    if (++separators == 2) return i + 1;
+                }
+            }
+
+            return 0;
+        }
+    }
+
+    // Interns strings, typically device paths, into one contiguous arena and hands out dense
+    // 32-bit IDs. Each distinct string is stored once, so comparing two interned strings is an
+    // ID comparison. Lookup goes through an open-addressed hash index over the arena.
+    //
+    // With prefix compression the enumerator and device ID part of each path (see
+    // details::device_path_prefix_length) is itself interned and shared, which pays off for
+    // devices that expose many interfaces or instances. Compressed strings are not stored
+    // contiguously, so c_str() is only available without it.
+    class string_table
+    {
+    public:
+        using id_type = std::uint32_t;
+        static constexpr id_type npos = 0xFFFFFFFF;
+
+    private:
+        struct entry
+        {
+            std::uint32_t hash;
+            id_type prefix;
+            std::uint32_t offset;
+            std::uint32_t length;
+        };
+
+        struct index
+        {
+            std::vector<id_type> slots;
+        };
+
+        bool m_compressPrefixes;
+        std::vector<wchar_t> m_arena;
+        std::vector<entry> m_entries;
+        std::vector<entry> m_prefixes;
+        index m_entryIndex;
+        index m_prefixIndex;
+
+        static size_t prefix_length(std::vector<entry> const & prefixes, entry const & e)
+        {
+            return e.prefix == npos ? 0 : prefixes[e.prefix].length;
+        }
+
+        bool matches(entry const & e, std::vector<entry> const & table, wchar_t const * str, size_t length, std::uint32_t hash) const
+        {
+            if (e.hash != hash) return false;
+
+            auto prefixLength = &table == &m_entries ? prefix_length(m_prefixes, e) : 0;
+            if (prefixLength + e.length != length) return false;
+
+            if (prefixLength != 0)
+            {
+                auto const & p = m_prefixes[e.prefix];
+                if (std::wmemcmp(&m_arena[p.offset], str, prefixLength) != 0) return false;
+            }
+
+            return std::wmemcmp(&m_arena[e.offset], str + prefixLength, e.length) == 0;
+        }
+
+        // Slot holding the matching ID, or the empty slot where it would go.
+        size_t probe(index const & idx, std::vector<entry> const & table, wchar_t const * str, size_t length, std::uint32_t hash) const
+        {
+            auto mask = idx.slots.size() - 1;
+            for (auto slot = hash & mask; ; slot = (slot + 1) & mask)
+            {
+                auto id = idx.slots[slot];
+                if (id == npos || matches(table[id], table, str, length, hash)) return slot;
+            }
+        }
+
+        static void grow(index & idx, std::vector<entry> const & table)
+        {
+            // keep the load factor at or below one half
+            if (idx.slots.size() >= 2 * (table.size() + 1)) return;
+
+            size_t size = idx.slots.empty() ? 64 : idx.slots.size() * 2;
+            idx.slots.assign(size, static_cast<id_type>(npos));
+
+            auto mask = size - 1;
+            for (id_type id = 0; id < table.size(); id++)
+            {
+                auto slot = table[id].hash & mask;
+                while (idx.slots[slot] != npos) slot = (slot + 1) & mask;
+                idx.slots[slot] = id;
+            }
+        }
+
+        bool append(wchar_t const * str, size_t length, std::uint32_t & offset)
+        {
+            // offsets are 32-bit; the terminator keeps uncompressed entries usable as C strings
+            if (m_arena.size() + length + 1 > 0xFFFFFFFF) return false;
+
+            offset = static_cast<std::uint32_t>(m_arena.size());
+            m_arena.insert(m_arena.end(), str, str + length);
+            m_arena.push_back(L'\0');
+
+            return true;
+        }
+
+        id_type intern_prefix(wchar_t const * str, size_t length)
+        {
+            grow(m_prefixIndex, m_prefixes);
+
+            auto hash = details::hash_chars(str, length);
+            auto slot = probe(m_prefixIndex, m_prefixes, str, length, hash);
+            if (m_prefixIndex.slots[slot] != npos) return m_prefixIndex.slots[slot];
+
+            entry e = { hash, npos, 0, static_cast<std::uint32_t>(length) };
+            if (!append(str, length, e.offset)) return npos;
+
+            auto id = static_cast<id_type>(m_prefixes.size());
+            m_prefixes.push_back(e);
+            m_prefixIndex.slots[slot] = id;
+
+            return id;
+        }
+
+    public:
+        explicit string_table(bool compressPrefixes = false) : m_compressPrefixes(compressPrefixes) { }
+
+        // Returns the string's ID, adding it if it is new. npos once the arena is full.
+        id_type intern(wchar_t const * str, size_t length)
+        {
+            grow(m_entryIndex, m_entries);
+
+            auto hash = details::hash_chars(str, length);
+            auto slot = probe(m_entryIndex, m_entries, str, length, hash);
+            if (m_entryIndex.slots[slot] != npos) return m_entryIndex.slots[slot];
+
+            if (m_entries.size() >= npos) return npos;
+
+            entry e = { hash, npos, 0, 0 };
+            size_t prefixLength = 0;
+
+            if (m_compressPrefixes)
+            {
+                prefixLength = details::device_path_prefix_length(str, length);
+                if (prefixLength != 0)
+                {
+                    e.prefix = intern_prefix(str, prefixLength);
+                    if (e.prefix == npos) return npos;
+                }
+            }
+
+            e.length = static_cast<std::uint32_t>(length - prefixLength);
+            if (!append(str + prefixLength, e.length, e.offset)) return npos;
+
+            auto id = static_cast<id_type>(m_entries.size());
+            m_entries.push_back(e);
+            m_entryIndex.slots[slot] = id;
+
+            return id;
+        }
+
+        id_type intern(wchar_t const * str)
+        {
+            return intern(str, std::wcslen(str));
+        }
+
+        // Interns every string of the list straight out of its buffer and writes their IDs to
+        // 'out', in list order.
+        template<typename OutIt>
+        OutIt intern(multi_sz_view list, OutIt out)
+        {
+            for (auto str : list)
+            {
+                *out++ = intern(str);
+            }
+
+            return out;
+        }
+
+        // npos if the string was never interned.
+        id_type find(wchar_t const * str, size_t length) const
+        {
+            if (m_entryIndex.slots.empty()) return npos;
+
+            auto slot = probe(m_entryIndex, m_entries, str, length, details::hash_chars(str, length));
+            return m_entryIndex.slots[slot];
+        }
+
+        id_type find(wchar_t const * str) const
+        {
+            return find(str, std::wcslen(str));
+        }
+
+        size_t size() const
+        {
+            return m_entries.size();
+        }
+
+        size_t length(id_type id) const
+        {
+            auto const & e = m_entries[id];
+            return prefix_length(m_prefixes, e) + e.length;
+        }
+
+        // Zero-copy access for tables without prefix compression; nullptr for compressed ones.
+        wchar_t const * c_str(id_type id) const
+        {
+            if (m_compressPrefixes) return nullptr;
+
+            return &m_arena[m_entries[id].offset];
+        }
+
+        void append_to(id_type id, std::wstring & out) const
+        {
+            auto const & e = m_entries[id];
+            if (e.prefix != npos)
+            {
+                auto const & p = m_prefixes[e.prefix];
+                out.append(&m_arena[p.offset], p.length);
+            }
+
+            out.append(&m_arena[e.offset], e.length);
+        }
+
+        std::wstring str(id_type id) const
+        {
+            std::wstring out;
+            out.reserve(length(id));
+            append_to(id, out);
+
+            return out;
+        }
+
+        // Bytes held by the arena, entry tables and hash indexes.
+        size_t memory_usage() const
+        {
+            return m_arena.capacity() * sizeof(wchar_t)
+                + (m_entries.capacity() + m_prefixes.capacity()) * sizeof(entry)
+                + (m_entryIndex.slots.capacity() + m_prefixIndex.slots.capacity()) * sizeof(id_type);
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <windows.h>
+#include <threadpoolapiset.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "event.h"
+#include "primitives.h"
+#include "resource_handle.h"
+#include "result.h"
+
+namespace wtl
+{
+    using tp_pool = resource_handle<PTP_POOL, int, 0, decltype(::CloseThreadpool), ::CloseThreadpool>;
+
+    // A private thread pool with a bounded number of threads. Callbacks registered against it
+    // never run on more than maxThreads threads at once, however many waits are outstanding.
+    // The pool must outlive every registration made against it.
+    class thread_pool
+    {
+        struct state
+        {
+            tp_pool pool;
+            TP_CALLBACK_ENVIRON environment;
+        };
+
+        std::unique_ptr<state> m_state;
+
+        explicit thread_pool(std::unique_ptr<state>&& s) : m_state(std::move(s)) { }
+
+    public:
+        thread_pool(thread_pool&& other) = default;
+        thread_pool & operator=(thread_pool&& other) = default;
+
+        ~thread_pool()
+        {
+            if (m_state)
+            {
+                ::DestroyThreadpoolEnvironment(&m_state->environment);
+            }
+        }
+
+        static win32_err_t<thread_pool> create(DWORD maxThreads, DWORD minThreads = 1)
+        {
+            std::unique_ptr<state> s(new (std::nothrow) state());
+            if (!s) return ERROR_NOT_ENOUGH_MEMORY;
+
+            s->pool = tp_pool(::CreateThreadpool(nullptr));
+            if (!s->pool) return GetLastError();
+
+            ::SetThreadpoolThreadMaximum(s->pool.get(), maxThreads);
+            if (!::SetThreadpoolThreadMinimum(s->pool.get(), minThreads)) return GetLastError();
+
+            ::InitializeThreadpoolEnvironment(&s->environment);
+            ::SetThreadpoolCallbackPool(&s->environment, s->pool.get());
+
+            return win32_err_t<thread_pool>::success(thread_pool(std::move(s)));
+        }
+
+        PTP_CALLBACK_ENVIRON environment() const
+        {
+            return &m_state->environment;
+        }
+    };
+
+    namespace details
+    {
+        inline PFILETIME to_relative_filetime(dword_milliseconds timeout, FILETIME & storage)
+        {
+            if (timeout == infinite) return nullptr;
+
+            // negative values are relative, in 100ns units
+            ULARGE_INTEGER due;
+            due.QuadPart = static_cast<ULONGLONG>(-static_cast<LONGLONG>(timeout.count()) * 10000);
+            storage.dwLowDateTime = due.LowPart;
+            storage.dwHighDateTime = due.HighPart;
+
+            return &storage;
+        }
+    }
+
+    // A callback bound to a waitable handle through a thread pool wait. No thread is parked on
+    // the handle; the pool's shared waiter threads watch it. The callback receives
+    // wait_result::signaled or wait_result::timeout and returns true to be re-armed with the
+    // same timeout, or false to go idle until rearm() is called.
+    //
+    // cancel() and the destructor wait for a running callback to finish, so they must not be
+    // called from inside the callback; return false there instead.
+    class registered_wait
+    {
+        struct state
+        {
+            PTP_WAIT wait = nullptr;
+            HANDLE handle = NULL;
+            dword_milliseconds timeout = infinite;
+            std::function<bool(wait_result)> callback;
+
+            // set by cancel() so a callback already running does not re-arm the wait
+            std::atomic<bool> cancelled{ false };
+        };
+
+        std::unique_ptr<state> m_state;
+
+        static void CALLBACK on_wait(PTP_CALLBACK_INSTANCE, PVOID context, PTP_WAIT wait, TP_WAIT_RESULT waitResult)
+        {
+            auto s = static_cast<state *>(context);
+            auto result = waitResult == WAIT_TIMEOUT ? wait_result::timeout : wait_result::signaled;
+
+            if (s->callback(result) && !s->cancelled)
+            {
+                FILETIME storage;
+                ::SetThreadpoolWait(wait, s->handle, details::to_relative_filetime(s->timeout, storage));
+            }
+        }
+
+        explicit registered_wait(std::unique_ptr<state>&& s) : m_state(std::move(s)) { }
+
+    public:
+        registered_wait() { }
+
+        registered_wait(registered_wait&& other) = default;
+
+        registered_wait & operator=(registered_wait&& other)
+        {
+            reset();
+            m_state = std::move(other.m_state);
+
+            return *this;
+        }
+
+        ~registered_wait()
+        {
+            reset();
+        }
+
+        template<typename Callback>
+        static win32_err_t<registered_wait> create(
+            HANDLE handle,
+            Callback&& callback,
+            dword_milliseconds timeout = infinite,
+            PTP_CALLBACK_ENVIRON environment = nullptr)
+        {
+            std::unique_ptr<state> s(new (std::nothrow) state());
+            if (!s) return ERROR_NOT_ENOUGH_MEMORY;
+
+            s->handle = handle;
+            s->timeout = timeout;
+            s->callback = std::forward<Callback>(callback);
+
+            s->wait = ::CreateThreadpoolWait(on_wait, s.get(), environment);
+            if (!s->wait) return GetLastError();
+
+            auto registration = registered_wait(std::move(s));
+            registration.rearm();
+
+            return win32_err_t<registered_wait>::success(std::move(registration));
+        }
+
+        operator bool() const { return m_state != nullptr; }
+
+        // Starts waiting again; cheap enough to call for every signal.
+        void rearm()
+        {
+            rearm(m_state->timeout);
+        }
+
+        void rearm(dword_milliseconds timeout)
+        {
+            m_state->timeout = timeout;
+            m_state->cancelled = false;
+
+            FILETIME storage;
+            ::SetThreadpoolWait(m_state->wait, m_state->handle, details::to_relative_filetime(timeout, storage));
+        }
+
+        // Stops waiting and waits for a callback in progress to return. The registration can be
+        // re-armed afterwards.
+        void cancel()
+        {
+            m_state->cancelled = true;
+
+            ::SetThreadpoolWait(m_state->wait, NULL, nullptr);
+            ::WaitForThreadpoolWaitCallbacks(m_state->wait, TRUE);
+
+            // a callback that passed its check before 'cancelled' was set may have re-armed
+            // the wait after the first SetThreadpoolWait; undo that, and wait out any firing
+            ::SetThreadpoolWait(m_state->wait, NULL, nullptr);
+            ::WaitForThreadpoolWaitCallbacks(m_state->wait, TRUE);
+        }
+
+        void reset()
+        {
+            if (m_state)
+            {
+                cancel();
+                ::CloseThreadpoolWait(m_state->wait);
+                m_state.reset();
+            }
+        }
+    };
+
+    template<typename Callback>
+    win32_err_t<registered_wait> register_wait(HANDLE handle, Callback&& callback, dword_milliseconds timeout = infinite)
+    {
+        return registered_wait::create(handle, std::forward<Callback>(callback), timeout);
+    }
+
+    template<typename Callback>
+    win32_err_t<registered_wait> register_wait(thread_pool const & pool, HANDLE handle, Callback&& callback, dword_milliseconds timeout = infinite)
+    {
+        return registered_wait::create(handle, std::forward<Callback>(callback), timeout, pool.environment());
+    }
+}
\ No newline at end of file
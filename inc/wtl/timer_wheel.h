@@ -0,0 +1,331 @@
+#pragma once
+
+#include <windows.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "result.h"
+#include "waitable_timer.h"
+
+namespace wtl
+{
+    struct timer_id
+    {
+        std::uint32_t index;
+        std::uint32_t generation;
+    };
+
+    // Hierarchical timing wheel: four levels of 256 slots, so arm and cancel are O(1) and only
+    // timers that reach the lowest level are ever touched again before they fire. Deadlines more
+    // than 256^4 ticks out are parked in the top level and re-cascaded until they come in range.
+    //
+    // The wheel keeps a waitable timer armed for its next wakeup. Its handle() can go into any of
+    // the library's waits (event waits, wait_set, register_wait); when it is signaled, call
+    // expire() to collect everything that is due in one batch. Not thread safe.
+    class timer_wheel
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+        using key_type = std::uint64_t;
+
+    private:
+        static constexpr unsigned level_bits = 8;
+        static constexpr unsigned slot_count = 1u << level_bits;
+        static constexpr unsigned level_count = 4;
+        static constexpr std::uint32_t npos = 0xFFFFFFFF;
+
+        struct node
+        {
+            std::uint64_t expires = 0;
+            key_type key = 0;
+            std::uint32_t prev = npos;
+            std::uint32_t next = npos;
+            std::uint32_t slot = npos;
+            std::uint32_t generation = 0;
+        };
+
+        waitable_timer m_timer;
+        clock::time_point m_epoch;
+        clock::duration m_resolution;
+        std::uint64_t m_now = 0;
+        std::uint64_t m_armedFor = 0;
+        size_t m_count = 0;
+
+        std::vector<node> m_nodes;
+        std::uint32_t m_free = npos;
+        std::array<std::uint32_t, level_count * slot_count> m_slots;
+
+        timer_wheel(waitable_timer&& timer, clock::duration resolution) :
+            m_timer(std::move(timer)),
+            m_epoch(clock::now()),
+            m_resolution(resolution)
+        {
+            m_slots.fill(npos);
+        }
+
+        // The last tick at or before 't'; how far the wheel may advance at time 't'.
+        std::uint64_t to_tick(clock::time_point t) const
+        {
+            if (t <= m_epoch) return 0;
+
+            return static_cast<std::uint64_t>((t - m_epoch) / m_resolution);
+        }
+
+        // The first tick at or after 't'; a deadline placed there never fires early.
+        std::uint64_t to_tick_ceil(clock::time_point t) const
+        {
+            if (t <= m_epoch) return 0;
+
+            auto elapsed = t - m_epoch;
+            auto ticks = static_cast<std::uint64_t>(elapsed / m_resolution);
+            if (elapsed % m_resolution != clock::duration::zero()) ticks++;
+
+            return ticks;
+        }
+
+        void link(std::uint32_t index, std::uint32_t slot)
+        {
+            auto & n = m_nodes[index];
+            n.slot = slot;
+            n.prev = npos;
+            n.next = m_slots[slot];
+
+            if (n.next != npos) m_nodes[n.next].prev = index;
+            m_slots[slot] = index;
+        }
+
+        void unlink(std::uint32_t index)
+        {
+            auto & n = m_nodes[index];
+
+            if (n.prev != npos) m_nodes[n.prev].next = n.next;
+            else m_slots[n.slot] = n.next;
+
+            if (n.next != npos) m_nodes[n.next].prev = n.prev;
+
+            n.slot = npos;
+        }
+
+        // Places a node relative to m_now. Expiries at or before m_now land in the current
+        // level-0 slot, which is only correct while that tick is being processed.
+        void place(std::uint32_t index)
+        {
+            auto expires = m_nodes[index].expires;
+            if (expires < m_now) expires = m_now;
+
+            auto delta = expires - m_now;
+
+            for (unsigned level = 0; level < level_count; level++)
+            {
+                if (delta < (std::uint64_t(1) << (level_bits * (level + 1))))
+                {
+                    auto slot = static_cast<std::uint32_t>((expires >> (level_bits * level)) & (slot_count - 1));
+                    link(index, level * slot_count + slot);
+                    return;
+                }
+            }
+
+            // out of range: park in the top-level slot processed last before wrapping around
+            auto top = level_count - 1;
+            auto slot = static_cast<std::uint32_t>(((m_now >> (level_bits * top)) - 1) & (slot_count - 1));
+            link(index, top * slot_count + slot);
+        }
+
+        void release(std::uint32_t index)
+        {
+            auto & n = m_nodes[index];
+            n.generation++;
+            n.next = m_free;
+            m_free = index;
+            m_count--;
+        }
+
+        void cascade(unsigned level, std::uint32_t slot)
+        {
+            auto index = m_slots[level * slot_count + slot];
+            m_slots[level * slot_count + slot] = npos;
+
+            while (index != npos)
+            {
+                auto next = m_nodes[index].next;
+                place(index);
+                index = next;
+            }
+        }
+
+        void tick(std::vector<key_type> & expired)
+        {
+            // cascade from the highest level down so entries moved out of an upper level can
+            // still be picked up by the lower level cascades of this same tick
+            unsigned highest = 0;
+            while (highest + 1 < level_count && (m_now & ((std::uint64_t(1) << (level_bits * (highest + 1))) - 1)) == 0)
+            {
+                highest++;
+            }
+
+            for (unsigned level = highest; level > 0; level--)
+            {
+                cascade(level, static_cast<std::uint32_t>((m_now >> (level_bits * level)) & (slot_count - 1)));
+            }
+
+            auto slot = static_cast<std::uint32_t>(m_now & (slot_count - 1));
+            auto index = m_slots[slot];
+            m_slots[slot] = npos;
+
+            while (index != npos)
+            {
+                auto next = m_nodes[index].next;
+                m_nodes[index].slot = npos;
+                expired.push_back(m_nodes[index].key);
+                release(index);
+                index = next;
+            }
+        }
+
+        // Earliest tick at which something could need attention: the next non-empty level-0 slot
+        // or the next cascade boundary, whichever comes first.
+        std::uint64_t next_wakeup() const
+        {
+            for (std::uint64_t t = m_now + 1; t <= m_now + slot_count; t++)
+            {
+                if ((t & (slot_count - 1)) == 0) return t;
+                if (m_slots[t & (slot_count - 1)] != npos) return t;
+            }
+
+            return m_now + slot_count;
+        }
+
+        win32_err rearm_timer()
+        {
+            if (m_count == 0)
+            {
+                m_armedFor = 0;
+                return m_timer.cancel();
+            }
+
+            auto wakeup = next_wakeup();
+            if (wakeup == m_armedFor) return ERROR_SUCCESS;
+
+            m_armedFor = wakeup;
+
+            auto due = m_epoch + m_resolution * static_cast<clock::rep>(wakeup);
+            return m_timer.set(due - clock::now());
+        }
+
+    public:
+        timer_wheel(timer_wheel&& other) = default;
+        timer_wheel & operator=(timer_wheel&& other) = default;
+
+        static win32_err_t<timer_wheel> create(clock::duration resolution = std::chrono::milliseconds(1))
+        {
+            if (resolution <= clock::duration::zero()) return ERROR_INVALID_PARAMETER;
+
+            RETURN_OR_UNWRAP(timer, waitable_timer::create());
+
+            return win32_err_t<timer_wheel>::success(timer_wheel(std::move(timer), resolution));
+        }
+
+        win32_err_t<timer_id> arm(clock::time_point deadline, key_type key)
+        {
+            std::uint32_t index;
+            if (m_free != npos)
+            {
+                index = m_free;
+                m_free = m_nodes[index].next;
+            }
+            else
+            {
+                if (m_nodes.size() >= npos) return ERROR_NOT_ENOUGH_MEMORY;
+
+                index = static_cast<std::uint32_t>(m_nodes.size());
+                m_nodes.emplace_back();
+            }
+
+            auto & n = m_nodes[index];
+            n.key = key;
+
+            // the current tick has already been processed
+            n.expires = std::max(to_tick_ceil(deadline), m_now + 1);
+
+            place(index);
+            m_count++;
+
+            auto rearmed = rearm_timer();
+            if (!rearmed) return rearmed.get_result();
+
+            return win32_err_t<timer_id>::success(timer_id{ index, n.generation });
+        }
+
+        template<typename Rep, typename Period>
+        win32_err_t<timer_id> arm(std::chrono::duration<Rep, Period> delay, key_type key)
+        {
+            return arm(clock::now() + std::chrono::duration_cast<clock::duration>(delay), key);
+        }
+
+        // Returns false if the timer already fired or was cancelled.
+        bool cancel(timer_id id)
+        {
+            if (id.index >= m_nodes.size()) return false;
+
+            auto & n = m_nodes[id.index];
+            if (n.generation != id.generation || n.slot == npos) return false;
+
+            unlink(id.index);
+            release(id.index);
+
+            return true;
+        }
+
+        size_t size() const
+        {
+            return m_count;
+        }
+
+        // Moves the wheel up to 'now' and calls callback(std::vector<key_type> const &) once with
+        // every key that came due, if any. Returns the number of expired timers. The callback may
+        // arm new timers.
+        template<typename Callback>
+        win32_err_t<size_t> expire(Callback&& callback, clock::time_point now = clock::now())
+        {
+            std::vector<key_type> expired;
+
+            auto target = to_tick(now);
+            if (m_count == 0 && target > m_now)
+            {
+                m_now = target;
+            }
+
+            while (m_now < target && m_count != 0)
+            {
+                m_now++;
+                tick(expired);
+            }
+
+            if (m_count == 0 && target > m_now)
+            {
+                m_now = target;
+            }
+
+            if (!expired.empty())
+            {
+                callback(static_cast<std::vector<key_type> const &>(expired));
+            }
+
+            m_armedFor = 0;
+            auto rearmed = rearm_timer();
+            if (!rearmed) return rearmed.get_result();
+
+            return win32_err_t<size_t>::success(expired.size());
+        }
+
+        // Signaled when expire() should next be called.
+        HANDLE handle() const
+        {
+            return m_timer.get();
+        }
+    };
+}
\ No newline at end of file
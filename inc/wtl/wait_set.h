@@ -0,0 +1,202 @@
+#pragma once
+
+#include <windows.h>
+#include <threadpoolapiset.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "event.h"
+#include "primitives.h"
+#include "result.h"
+
+namespace wtl
+{
+    // A runtime-sized set of waitable handles with no MAXIMUM_WAIT_OBJECTS limit. Each member is
+    // watched by a thread pool wait, so the system packs them onto its own waiter threads (63
+    // handles per thread) instead of one thread per handle. Signaled members are collected and
+    // handed out in batches by wait().
+    //
+    // Membership is level triggered: a member that is still signaled is reported again, but not
+    // before the wait() call after the one that reported it. add, remove and wait must be called
+    // from one thread at a time.
+    class wait_set
+    {
+    public:
+        using key_type = ULONG_PTR;
+
+    private:
+        struct state;
+
+        struct member
+        {
+            state * owner;
+            key_type key;
+            HANDLE handle;
+            PTP_WAIT wait;
+        };
+
+        struct state
+        {
+            event ready;
+            std::mutex lock;
+            std::vector<key_type> signaled;
+            std::vector<key_type> delivered;
+            std::unordered_map<key_type, std::unique_ptr<member>> members;
+
+            ~state()
+            {
+                for (auto & entry : members)
+                {
+                    close(*entry.second);
+                }
+            }
+
+            static void close(member & m)
+            {
+                ::SetThreadpoolWait(m.wait, NULL, nullptr);
+                ::WaitForThreadpoolWaitCallbacks(m.wait, TRUE);
+                ::CloseThreadpoolWait(m.wait);
+            }
+        };
+
+        std::unique_ptr<state> m_state;
+
+        explicit wait_set(std::unique_ptr<state>&& s) : m_state(std::move(s)) { }
+
+        static void CALLBACK on_signaled(PTP_CALLBACK_INSTANCE, PVOID context, PTP_WAIT, TP_WAIT_RESULT)
+        {
+            auto m = static_cast<member *>(context);
+            auto owner = m->owner;
+
+            bool wasEmpty;
+            {
+                std::lock_guard<std::mutex> guard(owner->lock);
+                wasEmpty = owner->signaled.empty();
+                owner->signaled.push_back(m->key);
+            }
+
+            if (wasEmpty)
+            {
+                owner->ready.set();
+            }
+        }
+
+        void rearm_delivered()
+        {
+            for (auto key : m_state->delivered)
+            {
+                auto found = m_state->members.find(key);
+                if (found != m_state->members.end())
+                {
+                    ::SetThreadpoolWait(found->second->wait, found->second->handle, nullptr);
+                }
+            }
+
+            m_state->delivered.clear();
+        }
+
+    public:
+        wait_set(wait_set&& other) = default;
+        wait_set & operator=(wait_set&& other) = default;
+
+        static win32_err_t<wait_set> create()
+        {
+            std::unique_ptr<state> s(new (std::nothrow) state());
+            if (!s) return ERROR_NOT_ENOUGH_MEMORY;
+
+            RETURN_OR_UNWRAP(ready, event::create());
+            s->ready = std::move(ready);
+
+            return win32_err_t<wait_set>::success(wait_set(std::move(s)));
+        }
+
+        // The handle must stay open until it is removed. Keys must be unique within the set.
+        win32_err add(HANDLE handle, key_type key)
+        {
+            if (m_state->members.count(key)) return ERROR_ALREADY_EXISTS;
+
+            std::unique_ptr<member> m(new (std::nothrow) member());
+            if (!m) return ERROR_NOT_ENOUGH_MEMORY;
+
+            m->owner = m_state.get();
+            m->key = key;
+            m->handle = handle;
+            m->wait = ::CreateThreadpoolWait(on_signaled, m.get(), nullptr);
+            if (!m->wait) return GetLastError();
+
+            ::SetThreadpoolWait(m->wait, handle, nullptr);
+
+            m_state->members.emplace(key, std::move(m));
+
+            return ERROR_SUCCESS;
+        }
+
+        // Stops watching the handle. Returns once no callback for it can still be running.
+        win32_err remove(key_type key)
+        {
+            auto found = m_state->members.find(key);
+            if (found == m_state->members.end()) return ERROR_NOT_FOUND;
+
+            state::close(*found->second);
+            m_state->members.erase(found);
+
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            auto & signaled = m_state->signaled;
+            signaled.erase(std::remove(signaled.begin(), signaled.end(), key), signaled.end());
+
+            return ERROR_SUCCESS;
+        }
+
+        size_t size() const
+        {
+            return m_state->members.size();
+        }
+
+        // Replaces the contents of 'keys' with up to maxBatch signaled members. Returns the
+        // number reported; zero means the deadline passed first.
+        win32_err_t<size_t> wait(std::vector<key_type> & keys, deadline until, size_t maxBatch = SIZE_MAX)
+        {
+            keys.clear();
+            rearm_delivered();
+
+            for (;;)
+            {
+                {
+                    std::lock_guard<std::mutex> guard(m_state->lock);
+                    auto & signaled = m_state->signaled;
+
+                    if (!signaled.empty())
+                    {
+                        auto count = std::min(maxBatch, signaled.size());
+                        keys.assign(signaled.begin(), signaled.begin() + count);
+                        signaled.erase(signaled.begin(), signaled.begin() + count);
+
+                        // more left for the next call; keep the event set
+                        if (!signaled.empty())
+                        {
+                            m_state->ready.set();
+                        }
+                    }
+                }
+
+                if (!keys.empty())
+                {
+                    m_state->delivered = keys;
+                    return win32_err_t<size_t>::success(keys.size());
+                }
+
+                RETURN_OR_UNWRAP(result, m_state->ready.wait(until));
+                if (result == wait_result::timeout) return win32_err_t<size_t>::success(0);
+            }
+        }
+
+        win32_err_t<size_t> wait(std::vector<key_type> & keys, dword_milliseconds timeout = infinite, size_t maxBatch = SIZE_MAX)
+        {
+            return wait(keys, timeout == infinite ? no_deadline : deadline_after(timeout), maxBatch);
+        }
+    };
+}
\ No newline at end of file
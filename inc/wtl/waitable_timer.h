@@ -0,0 +1,86 @@
+#pragma once
+
+#include <windows.h>
+#include <synchapi.h>
+
+#include <chrono>
+
+#include "event.h"
+#include "primitives.h"
+#include "resource_handle.h"
+#include "result.h"
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+namespace wtl
+{
+    class waitable_timer : public resource_handle<HANDLE, int, NULL, decltype(::CloseHandle), ::CloseHandle>
+    {
+    public:
+        waitable_timer() : resource_handle() { }
+
+        waitable_timer(HANDLE h) : resource_handle(h) { }
+
+        // Asks for a high resolution timer first and falls back to a regular one on systems
+        // that do not support it (before Windows 10 1803).
+        static win32_err_t<waitable_timer> create(bool bManualReset = false, PCWSTR lpName = nullptr, LPSECURITY_ATTRIBUTES lpTimerAttributes = nullptr)
+        {
+            const DWORD access = TIMER_ALL_ACCESS;
+            const DWORD manualReset = bManualReset ? CREATE_WAITABLE_TIMER_MANUAL_RESET : 0;
+
+            waitable_timer newTimer = ::CreateWaitableTimerExW(lpTimerAttributes, lpName, manualReset | CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, access);
+            if (!newTimer)
+            {
+                newTimer = ::CreateWaitableTimerExW(lpTimerAttributes, lpName, manualReset, access);
+                if (!newTimer) return GetLastError();
+            }
+
+            return win32_err_t<waitable_timer>::success(std::move(newTimer));
+        }
+
+        // Relative due time, rounded up to the timer's 100ns units.
+        template<typename Rep, typename Period>
+        win32_err set(std::chrono::duration<Rep, Period> dueIn, dword_milliseconds period = dword_milliseconds(0))
+        {
+            auto ticks = std::chrono::duration_cast<std::chrono::nanoseconds>(dueIn).count();
+            if (ticks < 0) ticks = 0;
+
+            LARGE_INTEGER due;
+            due.QuadPart = -static_cast<LONGLONG>((ticks + 99) / 100);
+
+            if (!::SetWaitableTimerEx(get(), &due, static_cast<LONG>(period.count()), nullptr, nullptr, nullptr, 0)) return GetLastError();
+
+            return ERROR_SUCCESS;
+        }
+
+        win32_err cancel()
+        {
+            if (!::CancelWaitableTimer(get())) return GetLastError();
+
+            return ERROR_SUCCESS;
+        }
+
+        win32_err_t<wait_result> wait(
+            dword_milliseconds timeout = infinite,
+            bool bAlertable = false)
+        {
+            auto result = static_cast<wait_result>(::WaitForSingleObjectEx(get(), timeout.count(), bAlertable));
+            if (result == wait_result::failed) return GetLastError();
+
+            return win32_err_t<wait_result>::success(result);
+        }
+
+        win32_err_t<wait_result> wait(
+            deadline until,
+            bool bAlertable = false)
+        {
+            HANDLE h = get();
+            auto result = static_cast<wait_result>(details::wait_until(1, &h, false, until, bAlertable));
+            if (result == wait_result::failed) return GetLastError();
+
+            return win32_err_t<wait_result>::success(result);
+        }
+    };
+}
\ No newline at end of file
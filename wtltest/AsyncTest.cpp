@@ -0,0 +1,166 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include <wtl\async.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace wtltest
+{
+    namespace
+    {
+        // Coroutines only record what they saw; asserting inside one would throw out of the
+        // frame and terminate the process.
+        struct read_outcome
+        {
+            DWORD error = ERROR_IO_INCOMPLETE;
+            DWORD bytesRead = 0;
+        };
+
+        wtl::detached_task read_then_stop(wtl::io_scheduler & scheduler, wtl::file & f, std::vector<char> & buffer, read_outcome & outcome)
+        {
+            auto result = co_await wtl::async_read(f, buffer.begin(), buffer.end(), 2);
+
+            outcome.error = result.get_result();
+            if (result) outcome.bytesRead = result.get();
+
+            scheduler.stop();
+        }
+
+        wtl::detached_task wait_then_stop(wtl::io_scheduler & scheduler, wtl::event const & signaled, wtl::event const & idle, std::vector<DWORD> & outcomes)
+        {
+            auto first = co_await wtl::async_wait(scheduler, signaled);
+            outcomes.push_back(first ? static_cast<DWORD>(first.get()) : first.get_result());
+
+            auto second = co_await wtl::async_wait(scheduler, idle, wtl::dword_milliseconds(10));
+            outcomes.push_back(second ? static_cast<DWORD>(second.get()) : second.get_result());
+
+            scheduler.stop();
+        }
+
+        wtl::detached_task wait_and_count(wtl::io_scheduler & scheduler, wtl::event const & signaled, std::atomic<int> & completed)
+        {
+            auto result = co_await wtl::async_wait(scheduler, signaled);
+            if (result) completed++;
+        }
+    }
+
+    TEST_CLASS(AsyncTest)
+    {
+    public:
+
+        TEST_METHOD(AsyncReadResumesOnScheduler)
+        {
+            std::string contents = "0123456789abcdef";
+
+            {
+                auto f = wtl::file::create(L"async.txt", GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS);
+                Assert::IsTrue(f);
+                Assert::IsTrue(f.get().write(contents.begin(), contents.end()));
+            }
+
+            auto f = wtl::file::create(L"async.txt", GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED);
+            Assert::IsTrue(f);
+
+            auto scheduler = wtl::io_scheduler::create();
+            Assert::IsTrue(scheduler);
+            Assert::IsTrue(scheduler.get().associate(f.get()));
+
+            std::vector<char> buffer(8);
+            read_outcome outcome;
+            read_then_stop(scheduler.get(), f.get(), buffer, outcome);
+
+            Assert::IsTrue(scheduler.get().run());
+            Assert::AreEqual(DWORD(ERROR_SUCCESS), outcome.error);
+            Assert::AreEqual(DWORD(8), outcome.bytesRead);
+            Assert::AreEqual(std::string("23456789"), std::string(buffer.begin(), buffer.end()));
+        }
+
+        TEST_METHOD(AsyncWaitSignaledAndTimeout)
+        {
+            auto scheduler = wtl::io_scheduler::create();
+            Assert::IsTrue(scheduler);
+
+            // already signaled, so the wait fires as soon as it is armed
+            auto signaled = wtl::event::create(true, true);
+            auto idle = wtl::event::create();
+            Assert::IsTrue(signaled);
+            Assert::IsTrue(idle);
+
+            std::vector<DWORD> outcomes;
+            wait_then_stop(scheduler.get(), signaled.get(), idle.get(), outcomes);
+
+            Assert::IsTrue(scheduler.get().run());
+            Assert::AreEqual(size_t(2), outcomes.size());
+            Assert::AreEqual(static_cast<DWORD>(wtl::wait_result::signaled), outcomes[0]);
+            Assert::AreEqual(static_cast<DWORD>(wtl::wait_result::timeout), outcomes[1]);
+        }
+
+        TEST_METHOD(StopReachesEveryRunner)
+        {
+            const int threadCount = 4;
+            const int operationCount = 200;
+
+            auto scheduler = wtl::io_scheduler::create();
+            Assert::IsTrue(scheduler);
+
+            auto signaled = wtl::event::create(true, true);
+            auto allReturned = wtl::event::create(false, true);
+            Assert::IsTrue(signaled);
+            Assert::IsTrue(allReturned);
+
+            std::atomic<int> returned{ 0 };
+            std::vector<std::thread> runners;
+            for (int i = 0; i < threadCount; i++)
+            {
+                runners.emplace_back([&]
+                {
+                    scheduler.get().run();
+                    if (++returned == threadCount) allReturned.get().set();
+                });
+            }
+
+            // completions keep arriving while the stops are posted, so one batch can pick up
+            // several stop requests
+            std::atomic<int> completed{ 0 };
+            for (int i = 0; i < operationCount; i++)
+            {
+                wait_and_count(scheduler.get(), signaled.get(), completed);
+            }
+
+            for (int i = 0; i < threadCount; i++)
+            {
+                Assert::IsTrue(scheduler.get().stop());
+            }
+
+            auto waited = allReturned.get().wait(wtl::dword_milliseconds(5000));
+
+            // unblock any runner a lost stop left behind before asserting, so the test can end
+            if (!waited || waited.get() != wtl::wait_result::signaled)
+            {
+                for (int i = 0; i < threadCount; i++) scheduler.get().stop();
+            }
+
+            for (auto & t : runners)
+            {
+                t.join();
+            }
+
+            Assert::IsTrue(waited);
+            Assert::IsTrue(wtl::wait_result::signaled == waited.get());
+
+            // finish the operations the runners left in the port
+            for (int i = 0; i < 100 && completed < operationCount; i++)
+            {
+                scheduler.get().run_once(wtl::dword_milliseconds(50));
+            }
+
+            Assert::AreEqual(operationCount, completed.load());
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include <wtl\device_info_range.h>
+#include <wtl\device_interface_cache.h>
+#include <wtl\device_property_snapshot.h>
+#include <wtl\parallel_enumerate.h>
+#include <wtl\string_table.h>
+
+#include <iterator>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace wtltest
+{
+    namespace
+    {
+        const GUID usbClass = { 0xa5dcbf10, 0x6530, 0x11d2, { 0x90, 0x1f, 0x00, 0xc0, 0x4f, 0xb9, 0x51, 0xed } };
+        const GUID hidClass = { 0x4d1e55b2, 0xf16f, 0x11cf, { 0x88, 0xcb, 0x00, 0x11, 0x11, 0x00, 0x00, 0x30 } };
+
+        // GUID_DEVINTERFACE_VOLUME; every machine running the tests has at least one
+        const GUID volumeClass = { 0x53f5630d, 0xb6bf, 0x11d0, { 0x94, 0xf2, 0x00, 0xa0, 0xc9, 0x1e, 0xfb, 0x8b } };
+
+        std::vector<std::wstring> to_vector(wtl::multi_sz const & list)
+        {
+            return std::vector<std::wstring>(list.begin(), list.end());
+        }
+
+        std::vector<std::wstring> to_vector(wtl::multi_sz_view list)
+        {
+            return std::vector<std::wstring>(list.begin(), list.end());
+        }
+    }
+
+    TEST_CLASS(DeviceTest)
+    {
+    public:
+
+        TEST_METHOD(InterfaceCacheInvalidatesOnNotification)
+        {
+            wtl::fake_cfgmgr cfgmgr;
+            cfgmgr.add_interface(usbClass, L"\\\\?\\USB#VID_0001&PID_0001#1");
+            cfgmgr.add_interface(hidClass, L"\\\\?\\HID#VID_0002&PID_0002#1");
+
+            auto cache = wtl::basic_device_interface_cache<wtl::fake_cfgmgr>::create(cfgmgr);
+            Assert::IsTrue(cache);
+
+            auto first = cache.get().get(usbClass);
+            auto second = cache.get().get(usbClass);
+            Assert::IsTrue(first);
+            Assert::IsTrue(second);
+            Assert::IsTrue(first.get() == second.get());
+            Assert::AreEqual(size_t(1), cfgmgr.list_calls());
+
+            Assert::AreEqual(size_t(1), to_vector(*cache.get().get(hidClass).get()).size());
+            Assert::AreEqual(size_t(2), cfgmgr.list_calls());
+
+            cfgmgr.add_interface(usbClass, L"\\\\?\\USB#VID_0001&PID_0001#2");
+
+            // the other class stays cached
+            cache.get().get(hidClass);
+            Assert::AreEqual(size_t(2), cfgmgr.list_calls());
+
+            auto third = cache.get().get(usbClass);
+            Assert::AreEqual(size_t(3), cfgmgr.list_calls());
+            Assert::AreEqual(size_t(2), to_vector(*third.get()).size());
+
+            // snapshots already handed out are immutable
+            Assert::AreEqual(size_t(1), to_vector(*first.get()).size());
+
+            Assert::IsTrue(cfgmgr.remove_interface(usbClass, L"\\\\?\\USB#VID_0001&PID_0001#1"));
+            Assert::AreEqual(size_t(1), to_vector(*cache.get().get(usbClass).get()).size());
+            Assert::AreEqual(size_t(4), cfgmgr.list_calls());
+        }
+
+        TEST_METHOD(InterfaceListReusesBuffer)
+        {
+            auto expected = wtl::cm::get_device_interface_list(volumeClass);
+            Assert::IsTrue(expected);
+            Assert::IsTrue(wtl::is_valid_multi_string_buffer(expected.get().view_buffer().begin(), expected.get().view_buffer().end()));
+
+            std::vector<wchar_t> buffer;
+            auto first = wtl::cm::get_device_interface_list(buffer, volumeClass);
+            Assert::IsTrue(first);
+            Assert::IsTrue(to_vector(expected.get()) == to_vector(first.get()));
+
+            auto data = buffer.data();
+            auto capacity = buffer.capacity();
+
+            auto second = wtl::cm::get_device_interface_list(buffer, volumeClass);
+            Assert::IsTrue(second);
+            Assert::IsTrue(data == buffer.data());
+            Assert::AreEqual(capacity, buffer.capacity());
+            Assert::IsTrue(to_vector(expected.get()) == to_vector(second.get()));
+
+            // a buffer that is too small is grown rather than failing with CR_BUFFER_SMALL
+            std::vector<wchar_t> tiny(1);
+            tiny.shrink_to_fit();
+            auto grown = wtl::cm::get_device_interface_list(tiny, volumeClass);
+            Assert::IsTrue(grown);
+            Assert::IsTrue(to_vector(expected.get()) == to_vector(grown.get()));
+        }
+
+        TEST_METHOD(DeviceInfoRangePrefetch)
+        {
+            const GUID anyClass = {};
+            auto devs = wtl::setup_di::get_class_devs(anyClass, nullptr, nullptr, DIGCF_ALLCLASSES | DIGCF_PRESENT);
+            Assert::IsTrue(devs);
+
+            DWORD expected = 0;
+            while (wtl::setup_di::enum_device_info(devs.get().get(), expected))
+            {
+                expected++;
+            }
+
+            Assert::IsTrue(expected > 0);
+
+            DWORD lazy = 0;
+            for (auto const & devInfoData : wtl::device_info_range(devs.get().get()))
+            {
+                Assert::AreEqual(DWORD(sizeof(SP_DEVINFO_DATA)), devInfoData.cbSize);
+                lazy++;
+            }
+
+            Assert::AreEqual(expected, lazy);
+
+            // a batch size that does not divide the count exercises the short final batch
+            auto range = wtl::device_info_range(devs.get().get(), 7, { SPDRP_HARDWAREID, SPDRP_CLASSGUID });
+
+            DWORD prefetched = 0;
+            for (auto it = range.begin(); it != range.end(); ++it)
+            {
+                Assert::AreEqual(prefetched, it.member_index());
+
+                auto devInfoData = *it;
+                WCHAR classGuid[64];
+                DWORD type;
+                if (SetupDiGetDeviceRegistryPropertyW(devs.get().get(), &devInfoData, SPDRP_CLASSGUID, &type, reinterpret_cast<PBYTE>(classGuid), sizeof(classGuid), nullptr))
+                {
+                    auto property = it.property(SPDRP_CLASSGUID);
+                    Assert::IsTrue(property);
+                    Assert::AreEqual(DWORD(REG_SZ), property.get().type);
+                    Assert::AreEqual(static_cast<PCWSTR>(classGuid), reinterpret_cast<PCWSTR>(property.get().data));
+                }
+
+                Assert::AreEqual(DWORD(ERROR_NOT_FOUND), it.property(SPDRP_FRIENDLYNAME).get_result());
+
+                prefetched++;
+            }
+
+            Assert::AreEqual(expected, prefetched);
+            Assert::IsTrue(range.error());
+        }
+
+        TEST_METHOD(PropertySnapshotMatchesPerDeviceQueries)
+        {
+            const GUID anyClass = {};
+            auto devs = wtl::setup_di::get_class_devs(anyClass, nullptr, nullptr, DIGCF_ALLCLASSES | DIGCF_PRESENT);
+            Assert::IsTrue(devs);
+
+            auto snapshot = wtl::device_property_snapshot::create(devs.get().get(), { SPDRP_HARDWAREID, SPDRP_CLASSGUID });
+            Assert::IsTrue(snapshot);
+
+            auto hardwareIds = snapshot.get().column(SPDRP_HARDWAREID);
+            auto classGuids = snapshot.get().column(SPDRP_CLASSGUID);
+            Assert::IsTrue(hardwareIds);
+            Assert::IsTrue(classGuids);
+            Assert::IsFalse(snapshot.get().column(SPDRP_FRIENDLYNAME));
+
+            auto range = wtl::device_info_range(devs.get().get(), 16, { SPDRP_HARDWAREID, SPDRP_CLASSGUID });
+
+            size_t device = 0;
+            for (auto it = range.begin(); it != range.end(); ++it, ++device)
+            {
+                Assert::IsTrue(device < snapshot.get().size());
+                Assert::AreEqual(it->DevInst, snapshot.get().devices()[device].DevInst);
+
+                auto expected = it.property(SPDRP_HARDWAREID);
+                auto actual = hardwareIds.get().get_multi_sz(device);
+                Assert::AreEqual(bool(expected), bool(actual));
+
+                if (expected)
+                {
+                    auto expectedIds = to_vector(wtl::multi_sz_view(reinterpret_cast<PCWSTR>(expected.get().data)));
+                    Assert::IsTrue(expectedIds == to_vector(actual.get()));
+                }
+
+                // a REG_SZ column is not readable as a multi-sz
+                if (classGuids.get().get(device))
+                {
+                    Assert::AreEqual(DWORD(ERROR_INVALID_DATATYPE), classGuids.get().get_multi_sz(device).get_result());
+                }
+            }
+
+            Assert::AreEqual(snapshot.get().size(), device);
+        }
+
+        TEST_METHOD(ParallelEnumerateMergesClasses)
+        {
+            const GUID emptyClass = { 0x1, 0x2, 0x3, { 0, 1, 2, 3, 4, 5, 6, 7 } };
+
+            wtl::fake_cfgmgr cfgmgr;
+            cfgmgr.add_interface(usbClass, L"\\\\?\\USB#VID_0001&PID_0001#1");
+            cfgmgr.add_interface(usbClass, L"\\\\?\\USB#VID_0001&PID_0002#1");
+            cfgmgr.add_interface(hidClass, L"\\\\?\\HID#VID_0002&PID_0002#1");
+            cfgmgr.add_interface(hidClass, L"\\\\?\\usb#vid_0001&pid_0001#1");
+            cfgmgr.set_latency(std::chrono::milliseconds(20));
+
+            const GUID classes[] = { usbClass, hidClass, emptyClass };
+
+            wtl::enumerate_options options;
+            options.thread_count = 3;
+
+            auto enumeration = wtl::parallel_enumerate(cfgmgr, std::begin(classes), std::end(classes), options);
+            Assert::IsTrue(enumeration);
+            Assert::AreEqual(size_t(3), cfgmgr.list_calls());
+
+            auto const & perClass = enumeration.get().classes;
+            Assert::AreEqual(size_t(3), perClass.size());
+            Assert::IsTrue(IsEqualGUID(hidClass, perClass[1].class_guid) != FALSE);
+            Assert::AreEqual(size_t(2), perClass[0].count);
+            Assert::AreEqual(size_t(2), perClass[1].count);
+            Assert::AreEqual(size_t(0), perClass[2].count);
+
+            for (auto const & entry : perClass)
+            {
+                Assert::IsTrue(entry.result == CR_SUCCESS);
+                Assert::IsTrue(entry.elapsed >= std::chrono::milliseconds(20));
+            }
+
+            // the lower-case path is the same interface as the first USB one, and the spelling
+            // from the earlier class is the one kept
+            std::vector<std::wstring> expected =
+            {
+                L"\\\\?\\HID#VID_0002&PID_0002#1",
+                L"\\\\?\\USB#VID_0001&PID_0001#1",
+                L"\\\\?\\USB#VID_0001&PID_0002#1",
+            };
+
+            auto entries = to_vector(enumeration.get().entries);
+            Assert::AreEqual(expected.size(), entries.size());
+
+            for (size_t i = 0; i < expected.size(); i++)
+            {
+                Assert::AreEqual(expected[i], entries[i]);
+            }
+        }
+
+        TEST_METHOD(StringTableInternsPaths)
+        {
+            const auto paths =
+                L"\\\\?\\USB#VID_0001&PID_0001#6&1&0&1#{a5dcbf10-6530-11d2-901f-00c04fb951ed}\0"
+                L"\\\\?\\USB#VID_0001&PID_0001#6&1&0&2#{a5dcbf10-6530-11d2-901f-00c04fb951ed}\0"
+                L"\\\\?\\USB#VID_0001&PID_0001#6&1&0&1#{a5dcbf10-6530-11d2-901f-00c04fb951ed}\0"
+                L"USB\\VID_0001&PID_0001\\6&1&0&1\0"
+                L"\0";
+
+            for (auto compress : { false, true })
+            {
+                wtl::string_table table(compress);
+
+                std::vector<wtl::string_table::id_type> ids;
+                table.intern(wtl::multi_sz_view(paths), std::back_inserter(ids));
+
+                Assert::AreEqual(size_t(4), ids.size());
+                Assert::AreEqual(size_t(3), table.size());
+                Assert::IsTrue(ids[0] == ids[2]);
+                Assert::IsTrue(ids[0] != ids[1]);
+
+                auto expected = to_vector(wtl::multi_sz_view(paths));
+                for (size_t i = 0; i < ids.size(); i++)
+                {
+                    Assert::AreEqual(expected[i], table.str(ids[i]));
+                    Assert::AreEqual(expected[i].size(), table.length(ids[i]));
+                    Assert::AreEqual(ids[i], table.find(expected[i].c_str()));
+                }
+
+                Assert::AreEqual(wtl::string_table::id_type(wtl::string_table::npos), table.find(L"USB\\VID_0001&PID_0001\\6&1&0&2"));
+                Assert::AreEqual(compress, table.c_str(ids[3]) == nullptr);
+            }
+        }
+    };
+}
\ No newline at end of file
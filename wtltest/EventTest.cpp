@@ -0,0 +1,192 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include <wtl\address_event.h>
+#include <wtl\thread_pool.h>
+#include <wtl\wait_set.h>
+
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace wtltest
+{
+    TEST_CLASS(EventTest)
+    {
+    public:
+
+        TEST_METHOD(AddressEventAutoReset)
+        {
+            auto e = wtl::address_event::create(true, false);
+            Assert::IsTrue(e);
+
+            Assert::IsTrue(wtl::wait_result::signaled == e.get().wait(wtl::dword_milliseconds(0)).get());
+            Assert::IsTrue(wtl::wait_result::timeout == e.get().wait(wtl::dword_milliseconds(0)).get());
+        }
+
+        TEST_METHOD(AddressEventManualReset)
+        {
+            auto e = wtl::address_event::create(false, true);
+            Assert::IsTrue(e);
+
+            Assert::IsTrue(wtl::wait_result::timeout == e.get().wait(wtl::dword_milliseconds(10)).get());
+
+            Assert::IsTrue(e.get().set());
+            Assert::IsTrue(wtl::wait_result::signaled == e.get().wait(wtl::dword_milliseconds(0)).get());
+            Assert::IsTrue(wtl::wait_result::signaled == e.get().wait(wtl::dword_milliseconds(0)).get());
+
+            Assert::IsTrue(e.get().reset());
+            Assert::IsTrue(wtl::wait_result::timeout == e.get().wait(wtl::dword_milliseconds(0)).get());
+        }
+
+        TEST_METHOD(AddressEventCrossThread)
+        {
+            auto e = wtl::address_event::create();
+            Assert::IsTrue(e);
+
+            auto & ev = e.get();
+            std::thread setter([&ev]
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                ev.set();
+            });
+
+            Assert::IsTrue(wtl::wait_result::signaled == ev.wait().get());
+            setter.join();
+        }
+
+        TEST_METHOD(LightEventPingPong)
+        {
+            auto ping = wtl::light_event::create();
+            auto pong = wtl::light_event::create();
+            Assert::IsTrue(ping);
+            Assert::IsTrue(pong);
+
+            auto & pingEvent = ping.get();
+            auto & pongEvent = pong.get();
+            const int rounds = 10000;
+
+            std::thread responder([&pingEvent, &pongEvent]
+            {
+                for (int i = 0; i < rounds; i++)
+                {
+                    pingEvent.wait();
+                    pongEvent.set();
+                }
+            });
+
+            for (int i = 0; i < rounds; i++)
+            {
+                Assert::IsTrue(pingEvent.set());
+                Assert::IsTrue(wtl::wait_result::signaled == pongEvent.wait(wtl::dword_milliseconds(5000)).get());
+            }
+
+            responder.join();
+
+            Assert::IsTrue(wtl::wait_result::timeout == pongEvent.wait(wtl::dword_milliseconds(0)).get());
+        }
+
+        TEST_METHOD(WaitSetBeyondMaximumWaitObjects)
+        {
+            auto set = wtl::wait_set::create();
+            Assert::IsTrue(set);
+
+            std::vector<wtl::event> events;
+            for (int i = 0; i < 200; i++)
+            {
+                auto e = wtl::event::create();
+                Assert::IsTrue(e);
+                Assert::IsTrue(set.get().add(e.get().get(), i));
+                events.push_back(std::move(e.get()));
+            }
+
+            std::vector<wtl::wait_set::key_type> keys;
+            Assert::AreEqual(size_t(0), set.get().wait(keys, wtl::dword_milliseconds(10)).get());
+
+            auto until = wtl::deadline_after(std::chrono::milliseconds(10));
+            Assert::AreEqual(size_t(0), set.get().wait(keys, until).get());
+            Assert::IsTrue(std::chrono::steady_clock::now() >= until);
+
+            Assert::IsTrue(events[3].set());
+            Assert::IsTrue(events[150].set());
+            Assert::IsTrue(events[199].set());
+
+            std::set<wtl::wait_set::key_type> seen;
+            while (seen.size() < 3)
+            {
+                Assert::IsTrue(set.get().wait(keys, wtl::dword_milliseconds(5000)).get() != 0);
+                seen.insert(keys.begin(), keys.end());
+            }
+
+            Assert::IsTrue(seen == std::set<wtl::wait_set::key_type>{ 3, 150, 199 });
+
+            // auto reset events were consumed by the pool wait
+            Assert::IsTrue(set.get().remove(150));
+            Assert::AreEqual(size_t(0), set.get().wait(keys, wtl::dword_milliseconds(10)).get());
+            Assert::AreEqual(size_t(199), set.get().size());
+        }
+
+        TEST_METHOD(RegisteredWaitRearm)
+        {
+            auto pool = wtl::thread_pool::create(2);
+            Assert::IsTrue(pool);
+
+            auto trigger = wtl::event::create();
+            auto done = wtl::event::create(false, true);
+            Assert::IsTrue(trigger);
+            Assert::IsTrue(done);
+
+            std::atomic<int> signals{ 0 };
+            HANDLE doneHandle = done.get().get();
+
+            auto registration = wtl::register_wait(pool.get(), trigger.get().get(), [&signals, doneHandle](wtl::wait_result result)
+            {
+                if (result != wtl::wait_result::signaled) return true;
+
+                if (++signals == 3)
+                {
+                    ::SetEvent(doneHandle);
+                    return false;
+                }
+
+                return true;
+            });
+            Assert::IsTrue(registration);
+
+            for (int i = 0; i < 3; i++)
+            {
+                Assert::IsTrue(trigger.get().set());
+                while (signals.load() == i) std::this_thread::yield();
+            }
+
+            Assert::IsTrue(wtl::wait_result::signaled == done.get().wait(wtl::dword_milliseconds(5000)).get());
+            Assert::AreEqual(3, signals.load());
+
+            registration.get().cancel();
+        }
+
+        TEST_METHOD(DeadlineWaitNeverReturnsEarly)
+        {
+            auto e = wtl::event::create();
+            Assert::IsTrue(e);
+
+            auto until = wtl::deadline_after(std::chrono::microseconds(2500));
+            Assert::IsTrue(wtl::wait_result::timeout == e.get().wait(until).get());
+            Assert::IsTrue(std::chrono::steady_clock::now() >= until);
+
+            Assert::IsTrue(e.get().set());
+            Assert::IsTrue(wtl::wait_result::signaled == e.get().wait(wtl::deadline_after(std::chrono::seconds(5))).get());
+
+            auto light = wtl::light_event::create();
+            Assert::IsTrue(light);
+
+            until = wtl::deadline_after(std::chrono::microseconds(1500));
+            Assert::IsTrue(wtl::wait_result::timeout == light.get().wait(until).get());
+            Assert::IsTrue(std::chrono::steady_clock::now() >= until);
+        }
+    };
+}
\ No newline at end of file
@@ -2,6 +2,21 @@
 #include "CppUnitTest.h"
 
 #include <wtl\file.h>
+#include <wtl\buffered_reader.h>
+#include <wtl\buffered_writer.h>
+#include <wtl\direct_io.h>
+#include <wtl\directory_range.h>
+#include <wtl\directory_watcher.h>
+#include <wtl\file_copy.h>
+#include <wtl\parallel_scan.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+
+#include <string>
+#include <vector>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -18,5 +33,401 @@ namespace wtltest
             Assert::IsTrue(file);
             Assert::IsTrue(file.get());
         }
+
+        std::string ReadAll(PCWSTR fileName, DWORD bufferSize)
+        {
+            auto reader = wtl::buffered_reader::open(fileName, bufferSize, 2, FILE_SHARE_READ | FILE_SHARE_WRITE);
+            Assert::IsTrue(reader);
+
+            std::string contents;
+            char chunk[5];
+            DWORD bytesRead;
+            do
+            {
+                Assert::IsTrue(reader.get().read(std::begin(chunk), std::end(chunk), &bytesRead));
+                contents.append(chunk, bytesRead);
+            } while (bytesRead == sizeof(chunk));
+
+            return contents;
+        }
+
+        TEST_METHOD(BufferedRoundTrip)
+        {
+            std::string expected;
+
+            {
+                auto writer = wtl::buffered_writer::open(L"buffered.txt", CREATE_ALWAYS, 16);
+                Assert::IsTrue(writer);
+
+                for (int i = 0; i < 100; i++)
+                {
+                    auto record = std::to_string(i) + "\n";
+                    expected += record;
+                    Assert::IsTrue(writer.get().append(record.begin(), record.end()));
+                }
+
+                Assert::IsTrue(writer.get().sync());
+            }
+
+            Assert::AreEqual(expected, ReadAll(L"buffered.txt", 7));
+            Assert::AreEqual(expected, ReadAll(L"buffered.txt", 4096));
+        }
+
+        TEST_METHOD(BufferedReadErrorIsSticky)
+        {
+            {
+                auto f = wtl::file::create(L"writeonly.txt", GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS);
+                Assert::IsTrue(f);
+
+                std::string contents = "0123456789";
+                Assert::IsTrue(f.get().write(contents.begin(), contents.end()));
+            }
+
+            // a handle without read access makes every ReadFile fail
+            auto f = wtl::file::create(L"writeonly.txt", GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED);
+            Assert::IsTrue(f);
+
+            auto reader = wtl::buffered_reader::attach(std::move(f.get()), 4, 2);
+            Assert::IsTrue(reader);
+
+            char chunk[5];
+            DWORD bytesRead = 1;
+            Assert::AreEqual(DWORD(ERROR_ACCESS_DENIED), reader.get().read(std::begin(chunk), std::end(chunk), &bytesRead).get_result());
+
+            // later reads report the failure rather than an empty read at the end of the file
+            Assert::AreEqual(DWORD(ERROR_ACCESS_DENIED), reader.get().read(std::begin(chunk), std::end(chunk), &bytesRead).get_result());
+            Assert::AreEqual(DWORD(0), bytesRead);
+            Assert::AreEqual(DWORD(ERROR_ACCESS_DENIED), reader.get().read(std::begin(chunk), std::end(chunk)).get_result());
+        }
+
+        TEST_METHOD(BackgroundFlush)
+        {
+            auto writer = wtl::buffered_writer::open(L"background.txt", CREATE_ALWAYS, 16, wtl::dword_milliseconds(10), true);
+            Assert::IsTrue(writer);
+
+            std::string record = "0123456789";
+            for (int i = 0; i < 10; i++)
+            {
+                Assert::IsTrue(writer.get().append(record.begin(), record.end()));
+            }
+
+            Assert::IsTrue(writer.get().flush());
+
+            auto contents = ReadAll(L"background.txt", 64);
+            Assert::AreEqual(size_t(100), contents.size());
+        }
+
+        TEST_METHOD(BackgroundFlushReportsWriteFailure)
+        {
+            {
+                auto f = wtl::file::create(L"readonly.txt", GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS);
+                Assert::IsTrue(f);
+            }
+
+            // a handle without write access makes every WriteFile fail
+            auto f = wtl::file::create(L"readonly.txt", GENERIC_READ, FILE_SHARE_READ);
+            Assert::IsTrue(f);
+
+            auto writer = wtl::buffered_writer::attach(std::move(f.get()), 16, wtl::infinite, true);
+            Assert::IsTrue(writer);
+
+            // the failure happens on the worker, so the appends themselves may still succeed
+            std::string record = "0123456789abcdef";
+            writer.get().append(record.begin(), record.end());
+            writer.get().append(record.begin(), record.begin() + 4);
+
+            Assert::AreEqual(DWORD(ERROR_ACCESS_DENIED), writer.get().flush().get_result());
+
+            // the data appended after the failure was dropped, so later flushes fail too
+            writer.get().append(record.begin(), record.begin() + 4);
+            Assert::AreEqual(DWORD(ERROR_ACCESS_DENIED), writer.get().flush().get_result());
+            Assert::AreEqual(DWORD(ERROR_ACCESS_DENIED), writer.get().sync().get_result());
+        }
+
+        TEST_METHOD(DirectIoAlignment)
+        {
+            auto file = wtl::direct_file::create(L"direct.bin", GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS);
+            Assert::IsTrue(file);
+
+            auto sectorSize = file.get().sector_size();
+            Assert::IsTrue(sectorSize != 0);
+            Assert::IsTrue(file.get().recommended_alignment() % sectorSize == 0);
+
+            auto pool = wtl::aligned_buffer_pool::create(sectorSize * 4, 2, sectorSize);
+            Assert::IsTrue(pool);
+
+            auto buffer = pool.get().acquire();
+            Assert::IsTrue(buffer);
+            Assert::IsTrue(reinterpret_cast<std::uintptr_t>(buffer.get().data()) % sectorSize == 0);
+
+            DWORD bytesWritten;
+            Assert::IsTrue(file.get().write_at(0, buffer.get(), &bytesWritten));
+            Assert::AreEqual(sectorSize * 4, bytesWritten);
+
+            Assert::AreEqual(static_cast<DWORD>(ERROR_OFFSET_ALIGNMENT_VIOLATION), file.get().read_at(1, buffer.get()).get_result());
+            Assert::AreEqual(static_cast<DWORD>(ERROR_INCORRECT_SIZE), file.get().read_at(0, buffer.get().data(), sectorSize - 1).get_result());
+            Assert::AreEqual(static_cast<DWORD>(ERROR_INVALID_USER_BUFFER), file.get().read_at(0, buffer.get().data() + 1, sectorSize).get_result());
+        }
+
+        TEST_METHOD(AlignedPoolExhaustion)
+        {
+            auto pool = wtl::aligned_buffer_pool::create(4096, 1, 512);
+            Assert::IsTrue(pool);
+
+            {
+                auto first = pool.get().acquire();
+                Assert::IsTrue(first);
+                Assert::AreEqual(static_cast<DWORD>(ERROR_NO_SYSTEM_RESOURCES), pool.get().acquire().get_result());
+            }
+
+            Assert::IsTrue(pool.get().acquire());
+        }
+
+        TEST_METHOD(ParallelScanRecords)
+        {
+            std::set<std::string> expected;
+
+            {
+                auto writer = wtl::buffered_writer::open(L"records.txt", CREATE_ALWAYS);
+                Assert::IsTrue(writer);
+
+                // records of varying length so boundaries land everywhere inside a chunk
+                for (int i = 0; i < 40000; i++)
+                {
+                    auto record = std::to_string(i) + std::string(i % 37, 'x') + "\n";
+                    expected.insert(record);
+                    Assert::IsTrue(writer.get().append(record.begin(), record.end()));
+                }
+            }
+
+            auto file = wtl::file::create(L"records.txt", GENERIC_READ, FILE_SHARE_READ);
+            Assert::IsTrue(file);
+
+            wtl::scan_options options;
+            options.chunk_size = 64 * 1024;
+            options.thread_count = 4;
+            options.delimiter = '\n';
+
+            // the callback runs on worker threads, where a failed assert would not reach the test
+            std::mutex lock;
+            std::multiset<std::string> seen;
+            size_t unterminated = 0;
+
+            auto result = wtl::parallel_file_scan(file.get(), [&](wtl::scan_chunk const & chunk)
+            {
+                auto begin = reinterpret_cast<char const *>(chunk.data);
+                auto end = begin + chunk.size;
+
+                std::lock_guard<std::mutex> guard(lock);
+                if (begin != end && end[-1] != '\n') unterminated++;
+
+                while (begin != end)
+                {
+                    auto next = std::find(begin, end, '\n');
+                    if (next != end) next++;
+
+                    seen.insert(std::string(begin, next));
+                    begin = next;
+                }
+
+                return true;
+            }, options);
+
+            Assert::IsTrue(result);
+            Assert::AreEqual(size_t(0), unterminated);
+            Assert::AreEqual(expected.size(), seen.size());
+            Assert::IsTrue(std::equal(expected.begin(), expected.end(), seen.begin()));
+
+            // a chunk plus its overlap has to fit in one read
+            options.chunk_size = 1u << 30;
+            options.max_record_size = MAXDWORD - options.chunk_size;
+            Assert::AreEqual(DWORD(ERROR_INVALID_PARAMETER), wtl::parallel_file_scan(file.get(), [](wtl::scan_chunk const &) { return true; }, options).get_result());
+        }
+
+        // A fresh directory under %TEMP% with 'files' empty files in each of 'dirs' subdirectories
+        // and in the directory itself.
+        std::wstring MakeTree(PCWSTR name, unsigned dirs, unsigned files)
+        {
+            wchar_t temp[MAX_PATH];
+            Assert::AreNotEqual(DWORD(0), ::GetTempPathW(MAX_PATH, temp));
+
+            auto root = std::wstring(temp) + name + L"." + std::to_wstring(::GetCurrentProcessId());
+            Assert::IsTrue(!!::CreateDirectoryW(root.c_str(), nullptr));
+
+            for (unsigned d = 0; d <= dirs; d++)
+            {
+                auto dir = d == 0 ? root : root + L"\\dir" + std::to_wstring(d);
+                if (d != 0) Assert::IsTrue(!!::CreateDirectoryW(dir.c_str(), nullptr));
+
+                for (unsigned f = 0; f < files; f++)
+                {
+                    Assert::IsTrue(wtl::file::create((dir + L"\\file" + std::to_wstring(f) + L".txt").c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW));
+                }
+            }
+
+            return root;
+        }
+
+        void RemoveTree(std::wstring const & root, unsigned dirs, unsigned files)
+        {
+            for (unsigned d = dirs + 1; d-- > 0; )
+            {
+                auto dir = d == 0 ? root : root + L"\\dir" + std::to_wstring(d);
+                for (unsigned f = 0; f < files; f++)
+                {
+                    ::DeleteFileW((dir + L"\\file" + std::to_wstring(f) + L".txt").c_str());
+                }
+
+                ::RemoveDirectoryW(dir.c_str());
+            }
+        }
+
+        TEST_METHOD(DirectoryRangeBatches)
+        {
+            auto root = MakeTree(L"wtl_dir_range", 0, 500);
+
+            {
+                // small enough that the listing takes several batches
+                auto range = wtl::directory_range::open(root.c_str(), 4096);
+                Assert::IsTrue(range);
+
+                std::set<std::wstring> names;
+                for (auto const & entry : range.get())
+                {
+                    Assert::IsFalse(entry.is_dot());
+                    Assert::IsFalse(entry.is_directory());
+                    Assert::AreEqual(std::uint64_t(0), entry.size());
+                    names.insert(entry.name());
+                }
+
+                Assert::IsTrue(range.get().error());
+                Assert::AreEqual(size_t(500), names.size());
+                Assert::IsTrue(names.count(L"file0.txt") == 1 && names.count(L"file499.txt") == 1);
+
+                Assert::IsTrue(range.get().begin() == range.get().end());
+            }
+
+            RemoveTree(root, 0, 500);
+        }
+
+        TEST_METHOD(DirectoryWalkParallel)
+        {
+            auto root = MakeTree(L"wtl_dir_walk", 20, 50);
+
+            // the callback runs on worker threads; record what it saw and assert here
+            std::mutex lock;
+            std::set<std::wstring> seen;
+            size_t duplicates = 0;
+
+            wtl::walk_options options;
+            options.thread_count = 4;
+
+            auto walked = wtl::walk_directory_tree(root.c_str(), [&](std::wstring const & directory, wtl::directory_entry const & entry)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (!seen.insert(directory + L"\\" + entry.name()).second) duplicates++;
+            }, options);
+
+            Assert::IsTrue(walked);
+            Assert::AreEqual(size_t(0), duplicates);
+            Assert::AreEqual(size_t(20 + 21 * 50), seen.size());
+            Assert::AreEqual(size_t(1), seen.count(root + L"\\dir20\\file49.txt"));
+
+            Assert::AreEqual(DWORD(ERROR_FILE_NOT_FOUND), wtl::walk_directory_tree((root + L"\\missing").c_str(), [](std::wstring const &, wtl::directory_entry const &) { }).get_result());
+
+            RemoveTree(root, 20, 50);
+        }
+
+        TEST_METHOD(DirectoryWatcherCoalesces)
+        {
+            auto root = MakeTree(L"wtl_dir_watch", 0, 0);
+
+            {
+                auto watcher = wtl::directory_watcher::create(wtl::dword_milliseconds(200));
+                Assert::IsTrue(watcher);
+                Assert::IsTrue(watcher.get().add(root.c_str()));
+                Assert::AreEqual(DWORD(ERROR_ALREADY_EXISTS), watcher.get().add(root.c_str()).get_result());
+
+                std::vector<wtl::file_change> changes;
+                Assert::AreEqual(size_t(0), watcher.get().take(changes));
+
+                // a burst of writes to a few files
+                for (unsigned f = 0; f < 3; f++)
+                {
+                    auto file = wtl::file::create((root + L"\\file" + std::to_wstring(f) + L".txt").c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW);
+                    Assert::IsTrue(file);
+
+                    std::string line = "line\n";
+                    for (int i = 0; i < 10; i++)
+                    {
+                        Assert::IsTrue(file.get().write(line.begin(), line.end()));
+                    }
+                }
+
+                std::map<std::wstring, DWORD> seen;
+                while (seen.size() < 3 && ::WaitForSingleObject(watcher.get().ready_handle(), 5000) == WAIT_OBJECT_0)
+                {
+                    watcher.get().take(changes);
+
+                    // each path appears once per change set
+                    std::set<std::wstring> batch;
+                    for (auto const & change : changes)
+                    {
+                        Assert::IsTrue(batch.insert(change.path).second);
+                        seen[change.path] |= change.actions;
+                    }
+                }
+
+                Assert::AreEqual(size_t(3), seen.size());
+                Assert::IsTrue((seen[root + L"\\file0.txt"] & (1u << FILE_ACTION_ADDED)) != 0);
+
+                // drain whatever the last writes produced, then stop watching
+                Assert::IsTrue(watcher.get().wait([](std::vector<wtl::file_change> const &) { }, wtl::dword_milliseconds(500)));
+                Assert::IsTrue(watcher.get().remove(root.c_str()));
+                Assert::AreEqual(size_t(0), watcher.get().size());
+
+                Assert::IsTrue(wtl::file::create((root + L"\\file3.txt").c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW));
+
+                // changes recorded before remove() may still be delivered, but nothing after it
+                auto late = watcher.get().wait(changes, wtl::dword_milliseconds(500));
+                Assert::IsTrue(late);
+                for (auto const & change : changes)
+                {
+                    Assert::AreNotEqual(root + L"\\file3.txt", change.path);
+                }
+            }
+
+            RemoveTree(root, 0, 4);
+        }
+
+        TEST_METHOD(CopyRange)
+        {
+            std::string contents = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+            auto src = wtl::file::create(L"copy_src.txt", GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS);
+            auto dst = wtl::file::create(L"copy_dst.txt", GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS);
+            Assert::IsTrue(src);
+            Assert::IsTrue(dst);
+
+            Assert::IsTrue(src.get().write(contents.begin(), contents.end()));
+
+            std::uint64_t lastProgress = 0;
+            auto copied = wtl::copy_range(src.get(), 10, dst.get(), 0, 26, [&](std::uint64_t done, std::uint64_t total)
+            {
+                Assert::AreEqual(std::uint64_t(26), total);
+                lastProgress = done;
+                return true;
+            });
+
+            Assert::IsTrue(copied);
+            Assert::AreEqual(std::uint64_t(26), copied.get());
+            Assert::AreEqual(std::uint64_t(26), lastProgress);
+
+            char buffer[26];
+            DWORD bytesRead;
+            auto readAt = wtl::overlapped::at(0);
+            Assert::IsTrue(dst.get().read(std::begin(buffer), std::end(buffer), &bytesRead, readAt.get()));
+            Assert::AreEqual(std::string("abcdefghijklmnopqrstuvwxyz"), std::string(buffer, bytesRead));
+        }
     };
 }
\ No newline at end of file
@@ -0,0 +1,355 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include <wtl\hive.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace wtltest
+{
+    namespace
+    {
+        // Builds a minimal regf image: a base block followed by one hive bin. Cells are appended
+        // bottom-up, so children are built before the keys that list them.
+        class hive_builder
+        {
+            std::vector<std::uint8_t> m_bins;
+
+            static void put16(std::vector<std::uint8_t> & body, size_t offset, std::uint16_t value)
+            {
+                std::memcpy(&body[offset], &value, sizeof(value));
+            }
+
+            static void put32(std::vector<std::uint8_t> & body, size_t offset, std::uint32_t value)
+            {
+                std::memcpy(&body[offset], &value, sizeof(value));
+            }
+
+            static std::uint32_t hash(std::wstring const & name)
+            {
+                std::uint32_t h = 0;
+                for (auto c : name) h = h * 37 + static_cast<std::uint32_t>(towupper(c));
+
+                return h;
+            }
+
+        public:
+            hive_builder() : m_bins(32)
+            {
+                std::memcpy(&m_bins[0], "hbin", 4);
+            }
+
+            std::uint32_t cell(std::vector<std::uint8_t> const & body)
+            {
+                auto size = (4 + body.size() + 7) & ~size_t(7);
+                auto offset = static_cast<std::uint32_t>(m_bins.size());
+                m_bins.resize(offset + size);
+
+                auto raw = -static_cast<std::int32_t>(size);
+                std::memcpy(&m_bins[offset], &raw, sizeof(raw));
+                if (!body.empty()) std::memcpy(&m_bins[offset + 4], body.data(), body.size());
+
+                return offset;
+            }
+
+            std::uint32_t lh(std::vector<std::pair<std::uint32_t, std::wstring>> const & keys)
+            {
+                std::vector<std::uint8_t> body(4 + 8 * keys.size());
+                std::memcpy(&body[0], "lh", 2);
+                put16(body, 2, static_cast<std::uint16_t>(keys.size()));
+
+                for (size_t i = 0; i < keys.size(); i++)
+                {
+                    put32(body, 4 + 8 * i, keys[i].first);
+                    put32(body, 8 + 8 * i, hash(keys[i].second));
+                }
+
+                return cell(body);
+            }
+
+            // "li" and "ri" lists are plain offsets
+            std::uint32_t list(char const * signature, std::vector<std::uint32_t> const & offsets)
+            {
+                std::vector<std::uint8_t> body(4 + 4 * offsets.size());
+                std::memcpy(&body[0], signature, 2);
+                put16(body, 2, static_cast<std::uint16_t>(offsets.size()));
+
+                for (size_t i = 0; i < offsets.size(); i++) put32(body, 4 + 4 * i, offsets[i]);
+
+                return cell(body);
+            }
+
+            std::uint32_t key(std::string const & name, std::uint32_t subkeyList, std::uint32_t subkeyCount, std::vector<std::uint32_t> const & values)
+            {
+                std::uint32_t valueList = 0xFFFFFFFF;
+                if (!values.empty())
+                {
+                    std::vector<std::uint8_t> body(4 * values.size());
+                    for (size_t i = 0; i < values.size(); i++) put32(body, 4 * i, values[i]);
+                    valueList = cell(body);
+                }
+
+                std::vector<std::uint8_t> body(76 + name.size());
+                std::memcpy(&body[0], "nk", 2);
+                put16(body, 2, 0x0020);
+                put32(body, 20, subkeyCount);
+                put32(body, 28, subkeyCount ? subkeyList : 0xFFFFFFFF);
+                put32(body, 36, static_cast<std::uint32_t>(values.size()));
+                put32(body, 40, valueList);
+                put16(body, 72, static_cast<std::uint16_t>(name.size()));
+                std::memcpy(&body[76], name.data(), name.size());
+
+                return cell(body);
+            }
+
+            std::uint32_t value(std::string const & name, DWORD type, std::vector<std::uint8_t> const & data)
+            {
+                std::vector<std::uint8_t> body(20 + name.size());
+                std::memcpy(&body[0], "vk", 2);
+                put16(body, 2, static_cast<std::uint16_t>(name.size()));
+                put32(body, 12, type);
+                put16(body, 16, 0x0001);
+                std::memcpy(&body[20], name.data(), name.size());
+
+                if (data.size() <= 4)
+                {
+                    put32(body, 4, 0x80000000 | static_cast<std::uint32_t>(data.size()));
+                    if (!data.empty()) std::memcpy(&body[8], data.data(), data.size());
+                }
+                else
+                {
+                    put32(body, 4, static_cast<std::uint32_t>(data.size()));
+                    put32(body, 8, cell(data));
+                }
+
+                return cell(body);
+            }
+
+            // Stores data as a "db" record of 16344 byte segments.
+            std::uint32_t big_value(std::string const & name, std::vector<std::uint8_t> const & data)
+            {
+                std::vector<std::uint32_t> segments;
+                for (size_t offset = 0; offset < data.size(); offset += 16344)
+                {
+                    auto end = std::min(data.size(), offset + 16344);
+                    segments.push_back(cell(std::vector<std::uint8_t>(data.begin() + offset, data.begin() + end)));
+                }
+
+                std::vector<std::uint8_t> list(4 * segments.size());
+                for (size_t i = 0; i < segments.size(); i++) put32(list, 4 * i, segments[i]);
+
+                std::vector<std::uint8_t> db(8);
+                std::memcpy(&db[0], "db", 2);
+                put16(db, 2, static_cast<std::uint16_t>(segments.size()));
+                put32(db, 4, cell(list));
+
+                std::vector<std::uint8_t> body(20 + name.size());
+                std::memcpy(&body[0], "vk", 2);
+                put16(body, 2, static_cast<std::uint16_t>(name.size()));
+                put32(body, 4, static_cast<std::uint32_t>(data.size()));
+                put32(body, 8, cell(db));
+                put32(body, 12, REG_BINARY);
+                put16(body, 16, 0x0001);
+                std::memcpy(&body[20], name.data(), name.size());
+
+                return cell(body);
+            }
+
+            std::vector<std::uint8_t> finish(std::uint32_t root)
+            {
+                auto bins = m_bins;
+                bins.resize((bins.size() + 4095) & ~size_t(4095));
+                put32(bins, 8, static_cast<std::uint32_t>(bins.size()));
+
+                std::vector<std::uint8_t> image(4096);
+                std::memcpy(&image[0], "regf", 4);
+                put32(image, 0x24, root);
+                put32(image, 0x28, static_cast<std::uint32_t>(bins.size()));
+
+                image.insert(image.end(), bins.begin(), bins.end());
+                return image;
+            }
+        };
+
+        std::vector<std::uint8_t> wide_bytes(wchar_t const * str, size_t length)
+        {
+            auto bytes = reinterpret_cast<std::uint8_t const *>(str);
+            return std::vector<std::uint8_t>(bytes, bytes + length * sizeof(wchar_t));
+        }
+
+        // ROOT
+        //   Software
+        //     Vendor: Paths (REG_MULTI_SZ), Count (REG_DWORD), Blob (big REG_BINARY)
+        //   System: Broken (REG_MULTI_SZ without its terminator)
+        std::vector<std::uint8_t> sample_hive(std::vector<std::uint8_t> const & blob)
+        {
+            hive_builder builder;
+
+            DWORD count = 7;
+            auto paths = builder.value("Paths", REG_MULTI_SZ, wide_bytes(L"C:\\a\0D:\\b\0", 11));
+            auto countValue = builder.value("Count", REG_DWORD, std::vector<std::uint8_t>(reinterpret_cast<std::uint8_t *>(&count), reinterpret_cast<std::uint8_t *>(&count) + 4));
+            auto blobValue = builder.big_value("Blob", blob);
+            auto vendor = builder.key("Vendor", 0, 0, { paths, countValue, blobValue });
+
+            auto software = builder.key("Software", builder.lh({ { vendor, L"Vendor" } }), 1, {});
+
+            auto broken = builder.value("Broken", REG_MULTI_SZ, wide_bytes(L"abc", 3));
+            auto system = builder.key("System", 0, 0, { broken });
+
+            // split the root's subkeys over an "ri" list to cover the indirect layout
+            auto list = builder.list("ri", { builder.lh({ { software, L"Software" } }), builder.list("li", { system }) });
+            auto root = builder.key("ROOT", list, 2, {});
+
+            return builder.finish(root);
+        }
+
+        std::vector<std::uint8_t> sample_blob()
+        {
+            std::vector<std::uint8_t> blob(20000);
+            for (size_t i = 0; i < blob.size(); i++) blob[i] = static_cast<std::uint8_t>(i * 31);
+
+            return blob;
+        }
+    }
+
+    TEST_CLASS(HiveTest)
+    {
+    public:
+
+        TEST_METHOD(HiveLookupsAndValues)
+        {
+            auto blob = sample_blob();
+            auto image = sample_hive(blob);
+
+            auto h = wtl::hive::attach(image.data(), image.size());
+            Assert::IsTrue(h);
+
+            auto rootKey = h.get().root();
+            Assert::IsTrue(rootKey);
+
+            auto root = rootKey.get();
+            Assert::AreEqual(std::wstring(L"ROOT"), root.name().str());
+            Assert::AreEqual(2u, root.subkey_count());
+
+            std::vector<std::wstring> names;
+            Assert::IsTrue(root.for_each_subkey([&](wtl::hive_key const & key) { names.push_back(key.name().str()); return true; }));
+            Assert::IsTrue(std::vector<std::wstring>{ L"Software", L"System" } == names);
+
+            auto vendor = h.get().open_key(L"software\\VENDOR");
+            Assert::IsTrue(vendor);
+            Assert::AreEqual(3u, vendor.get().value_count());
+            Assert::AreEqual(DWORD(ERROR_FILE_NOT_FOUND), h.get().open_key(L"Software\\Missing").get_result());
+
+            auto paths = vendor.get().value(L"paths");
+            Assert::IsTrue(paths);
+            auto list = paths.get().get_multi_sz();
+            Assert::IsTrue(list);
+            Assert::IsTrue(std::vector<std::wstring>{ L"C:\\a", L"D:\\b" } == std::vector<std::wstring>(list.get().begin(), list.get().end()));
+
+            auto count = vendor.get().value(L"Count");
+            Assert::IsTrue(count);
+            auto countData = count.get().data();
+            Assert::IsTrue(countData);
+            Assert::AreEqual(size_t(4), countData.get().size);
+            DWORD countValue;
+            std::memcpy(&countValue, countData.get().data, sizeof(countValue));
+            Assert::AreEqual(DWORD(7), countValue);
+            Assert::AreEqual(DWORD(ERROR_INVALID_DATATYPE), count.get().get_multi_sz().get_result());
+
+            auto blobValue = vendor.get().value(L"Blob");
+            Assert::IsTrue(blobValue);
+            Assert::AreEqual(DWORD(ERROR_NOT_SUPPORTED), blobValue.get().data().get_result());
+            std::vector<std::uint8_t> copied;
+            Assert::IsTrue(blobValue.get().copy_data(copied));
+            Assert::IsTrue(blob == copied);
+
+            auto broken = h.get().open_key(L"System").get().value(L"Broken");
+            Assert::IsTrue(broken);
+            Assert::AreEqual(DWORD(ERROR_INVALID_DATA), broken.get().get_multi_sz().get_result());
+        }
+
+        TEST_METHOD(HiveIndexMatchesWalk)
+        {
+            auto image = sample_hive(sample_blob());
+
+            auto h = wtl::hive::attach(image.data(), image.size());
+            Assert::IsTrue(h);
+
+            auto walked = h.get().open_key(L"Software\\Vendor");
+            Assert::IsTrue(walked);
+
+            auto indexed = h.get().build_index();
+            Assert::IsTrue(indexed);
+            Assert::AreEqual(size_t(4), indexed.get());
+
+            auto found = h.get().open_key(L"\\SOFTWARE\\vendor\\");
+            Assert::IsTrue(found);
+            Assert::AreEqual(walked.get().offset(), found.get().offset());
+            Assert::AreEqual(DWORD(ERROR_FILE_NOT_FOUND), h.get().open_key(L"Software\\Missing").get_result());
+
+            // repeated separators are collapsed the same way the walk does
+            auto repeated = h.get().open_key(L"Software\\\\\\Vendor");
+            Assert::IsTrue(repeated);
+            Assert::AreEqual(walked.get().offset(), repeated.get().offset());
+        }
+
+        TEST_METHOD(HiveEmptyHasNoRoot)
+        {
+            wtl::hive h;
+            Assert::IsFalse(h.root());
+            Assert::IsFalse(h.open_key(L"Software"));
+            Assert::IsFalse(h.build_index());
+        }
+
+        TEST_METHOD(HiveRejectsCorruptImages)
+        {
+            auto image = sample_hive(sample_blob());
+
+            Assert::AreEqual(DWORD(ERROR_BADDB), wtl::hive::attach(image.data(), 100).get_result());
+
+            auto badSignature = image;
+            badSignature[0] = 'x';
+            Assert::AreEqual(DWORD(ERROR_BADDB), wtl::hive::attach(badSignature.data(), badSignature.size()).get_result());
+
+            // a root cell offset past the end of the bins
+            auto badRoot = image;
+            std::uint32_t offset = 0x7FFFFFF0;
+            std::memcpy(&badRoot[0x24], &offset, sizeof(offset));
+            Assert::AreEqual(DWORD(ERROR_BADDB), wtl::hive::attach(badRoot.data(), badRoot.size()).get_result());
+        }
+
+        TEST_METHOD(HiveOpensMappedFile)
+        {
+            auto image = sample_hive(sample_blob());
+
+            wchar_t dir[MAX_PATH];
+            wchar_t path[MAX_PATH];
+            Assert::AreNotEqual(DWORD(0), ::GetTempPathW(MAX_PATH, dir));
+            Assert::AreNotEqual(UINT(0), ::GetTempFileNameW(dir, L"hiv", 0, path));
+
+            {
+                auto f = wtl::file::create(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS);
+                Assert::IsTrue(f);
+
+                DWORD written;
+                Assert::IsTrue(!!::WriteFile(f.get().get(), image.data(), static_cast<DWORD>(image.size()), &written, nullptr));
+            }
+
+            {
+                auto h = wtl::hive::open(path);
+                Assert::IsTrue(h);
+
+                auto vendor = h.get().open_key(L"Software\\Vendor");
+                Assert::IsTrue(vendor);
+                Assert::IsTrue(vendor.get().value(L"Paths"));
+            }
+
+            ::DeleteFileW(path);
+        }
+    };
+}
\ No newline at end of file
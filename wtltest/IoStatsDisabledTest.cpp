@@ -0,0 +1,56 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#define WTL_DISABLE_IO_STATS
+#include <wtl\io_stats.h>
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace wtltest
+{
+    // Built with WTL_DISABLE_IO_STATS alongside IoStatsTest, which is not.
+    TEST_CLASS(IoStatsDisabledTest)
+    {
+    public:
+
+        TEST_METHOD(DisabledStatsRecordNothing)
+        {
+            static_assert(std::is_empty<wtl::io_stats>::value, "the disabled io_stats should carry no state");
+
+            wtl::io_stats stats;
+            stats.begin(wtl::io_kind::read).complete(10);
+            stats.begin(wtl::io_kind::write).fail();
+
+            auto snapshot = stats.snapshot();
+            Assert::AreEqual(std::uint64_t(0), snapshot.reads);
+            Assert::AreEqual(std::uint64_t(0), snapshot.write_failures);
+            Assert::AreEqual(std::uint64_t(0), snapshot.read_latency.count());
+        }
+
+        TEST_METHOD(DisabledInstrumentedFileStillTransfers)
+        {
+            std::string contents = "0123456789";
+
+            auto created = wtl::file::create(L"iostats_disabled.txt", GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS);
+            Assert::IsTrue(created);
+
+            wtl::instrumented_file f(std::move(created.get()));
+            Assert::IsTrue(f.write(contents.begin(), contents.end()));
+
+            LARGE_INTEGER start = {};
+            Assert::IsTrue(::SetFilePointerEx(f.get(), start, nullptr, FILE_BEGIN) != FALSE);
+
+            std::vector<char> buffer(10);
+            DWORD bytesRead = 0;
+            Assert::IsTrue(f.read(buffer.begin(), buffer.end(), &bytesRead));
+            Assert::AreEqual(DWORD(10), bytesRead);
+            Assert::AreEqual(contents, std::string(buffer.begin(), buffer.end()));
+
+            Assert::AreEqual(std::uint64_t(0), f.stats().snapshot().reads);
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,179 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include <wtl\io_stats.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace wtltest
+{
+    TEST_CLASS(IoStatsTest)
+    {
+    public:
+
+        TEST_METHOD(BucketIndexBounds)
+        {
+            typedef wtl::latency_histogram histogram;
+
+            // below the first power of two that is split, every value has its own bucket
+            for (std::uint64_t v = 0; v < histogram::sub_bucket_count; v++)
+            {
+                Assert::AreEqual(static_cast<unsigned>(v), histogram::bucket_index(v));
+                Assert::AreEqual(v, histogram::bucket_lower_bound(histogram::bucket_index(v)));
+            }
+
+            Assert::AreEqual(63u, histogram::bucket_index(1000));
+            Assert::AreEqual(std::uint64_t(960), histogram::bucket_lower_bound(63));
+            Assert::AreEqual(histogram::bucket_count - 1, histogram::bucket_index(~std::uint64_t(0)));
+
+            std::vector<std::uint64_t> values = { 8, 9, 15, 16, 17, 100, 1023, 1024, 1025, 123456789, std::uint64_t(1) << 40, (std::uint64_t(1) << 63) + 1 };
+            for (auto v : values)
+            {
+                auto index = histogram::bucket_index(v);
+                auto lower = histogram::bucket_lower_bound(index);
+
+                Assert::IsTrue(index < histogram::bucket_count);
+                Assert::IsTrue(lower <= v);
+                Assert::IsTrue(v - lower <= lower / histogram::sub_bucket_count);
+                Assert::IsTrue(v < histogram::bucket_lower_bound(index + 1));
+            }
+        }
+
+        TEST_METHOD(Percentile)
+        {
+            wtl::latency_histogram histogram;
+            Assert::AreEqual(std::uint64_t(0), histogram.percentile(50));
+
+            for (int i = 0; i < 90; i++) histogram.record(1);
+            for (int i = 0; i < 10; i++) histogram.record(7);
+
+            Assert::AreEqual(std::uint64_t(100), histogram.count());
+            Assert::AreEqual(std::uint64_t(1), histogram.percentile(0));
+            Assert::AreEqual(std::uint64_t(1), histogram.percentile(50));
+            Assert::AreEqual(std::uint64_t(7), histogram.percentile(95));
+            Assert::AreEqual(std::uint64_t(7), histogram.percentile(100));
+
+            wtl::latency_histogram other;
+            for (int i = 0; i < 100; i++) other.record(1000);
+
+            histogram.merge(other);
+            Assert::AreEqual(std::uint64_t(200), histogram.count());
+            Assert::AreEqual(std::uint64_t(960), histogram.percentile(99));
+        }
+
+        TEST_METHOD(SnapshotMergesThreads)
+        {
+            const int threadCount = 4;
+            const int perThread = 1000;
+
+            wtl::io_stats stats;
+
+            std::vector<std::thread> threads;
+            for (int t = 0; t < threadCount; t++)
+            {
+                threads.emplace_back([&stats, perThread]
+                {
+                    for (int i = 0; i < perThread; i++)
+                    {
+                        stats.begin(wtl::io_kind::read).complete(10);
+                        stats.begin(wtl::io_kind::write).complete(3);
+                    }
+
+                    stats.begin(wtl::io_kind::write).fail();
+                });
+            }
+
+            for (auto & t : threads)
+            {
+                t.join();
+            }
+
+            auto snapshot = stats.snapshot();
+            Assert::AreEqual(std::uint64_t(threadCount * perThread), snapshot.reads);
+            Assert::AreEqual(std::uint64_t(threadCount * perThread), snapshot.writes);
+            Assert::AreEqual(std::uint64_t(threadCount * perThread * 10), snapshot.bytes_read);
+            Assert::AreEqual(std::uint64_t(threadCount * perThread * 3), snapshot.bytes_written);
+            Assert::AreEqual(std::uint64_t(0), snapshot.read_failures);
+            Assert::AreEqual(std::uint64_t(threadCount), snapshot.write_failures);
+            Assert::AreEqual(std::uint64_t(threadCount * perThread), snapshot.read_latency.count());
+            Assert::AreEqual(std::uint64_t(threadCount * perThread), snapshot.write_latency.count());
+            Assert::AreEqual(std::int64_t(0), snapshot.in_flight);
+            Assert::IsTrue(snapshot.max_in_flight >= 1);
+        }
+
+        TEST_METHOD(InFlightAcrossThreads)
+        {
+            wtl::io_stats stats;
+
+            auto first = stats.begin(wtl::io_kind::read);
+            auto second = stats.begin(wtl::io_kind::read);
+            Assert::AreEqual(std::int64_t(2), stats.snapshot().in_flight);
+            Assert::AreEqual(std::int64_t(2), stats.snapshot().max_in_flight);
+
+            // completing on another thread leaves the issuing shard's count balanced
+            std::thread([&] { first.complete(1); }).join();
+            Assert::AreEqual(std::int64_t(1), stats.snapshot().in_flight);
+
+            {
+                auto abandoned = std::move(second);
+            }
+
+            Assert::AreEqual(std::int64_t(0), stats.snapshot().in_flight);
+            Assert::AreEqual(std::uint64_t(1), stats.snapshot().reads);
+        }
+
+        TEST_METHOD(MovedFromStatsRecordsNothing)
+        {
+            wtl::io_stats stats;
+            wtl::io_stats moved(std::move(stats));
+
+            stats.begin(wtl::io_kind::read).complete(5);
+            Assert::AreEqual(std::uint64_t(0), stats.snapshot().reads);
+
+            moved.begin(wtl::io_kind::read).complete(5);
+            Assert::AreEqual(std::uint64_t(1), moved.snapshot().reads);
+        }
+
+        TEST_METHOD(InstrumentedFileCountsFailures)
+        {
+            std::string contents = "0123456789";
+
+            auto created = wtl::file::create(L"iostats.txt", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, CREATE_ALWAYS);
+            Assert::IsTrue(created);
+
+            wtl::instrumented_file f(std::move(created.get()));
+
+            DWORD written = 0;
+            Assert::IsTrue(f.write(contents.begin(), contents.end(), &written));
+            Assert::AreEqual(DWORD(10), written);
+
+            LARGE_INTEGER start = {};
+            Assert::IsTrue(::SetFilePointerEx(f.get(), start, nullptr, FILE_BEGIN) != FALSE);
+
+            std::vector<char> buffer(10);
+            Assert::IsTrue(f.read(buffer.begin(), buffer.end()));
+            Assert::AreEqual(contents, std::string(buffer.begin(), buffer.end()));
+
+            auto readOnly = wtl::file::create(L"iostats.txt", GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING);
+            Assert::IsTrue(readOnly);
+
+            wtl::instrumented_file ro(std::move(readOnly.get()));
+            Assert::IsFalse(ro.write(contents.begin(), contents.end()));
+
+            auto snapshot = f.stats().snapshot();
+            Assert::AreEqual(std::uint64_t(1), snapshot.reads);
+            Assert::AreEqual(std::uint64_t(1), snapshot.writes);
+            Assert::AreEqual(std::uint64_t(10), snapshot.bytes_read);
+            Assert::AreEqual(std::uint64_t(10), snapshot.bytes_written);
+
+            auto failed = ro.stats().snapshot();
+            Assert::AreEqual(std::uint64_t(0), failed.writes);
+            Assert::AreEqual(std::uint64_t(1), failed.write_failures);
+            Assert::AreEqual(std::int64_t(0), failed.in_flight);
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include <wtl\service_monitor.h>
+
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace wtltest
+{
+    TEST_CLASS(ServiceTest)
+    {
+    public:
+
+        TEST_METHOD(SharedScmIsReused)
+        {
+            auto first = wtl::service::shared_scm();
+            auto second = wtl::service::shared_scm();
+            Assert::IsTrue(first);
+            Assert::IsTrue(second);
+            Assert::IsTrue(first.get() == second.get());
+        }
+
+        TEST_METHOD(MonitorDeliversOnlyDeltas)
+        {
+            wtl::fake_scm scm;
+            scm.add_service(L"alpha", SERVICE_RUNNING, 100);
+            scm.add_service(L"beta", SERVICE_STOPPED);
+
+            auto monitor = wtl::basic_service_monitor<wtl::fake_scm>::create(scm);
+            Assert::IsTrue(monitor);
+            Assert::AreEqual(size_t(2), monitor.get().size());
+            Assert::AreEqual(size_t(1), scm.enumerate_calls());
+
+            auto alpha = monitor.get().find(L"alpha");
+            auto beta = monitor.get().find(L"beta");
+            Assert::AreEqual(DWORD(SERVICE_RUNNING), monitor.get().status(alpha).dwCurrentState);
+
+            std::vector<wtl::service_change> changes;
+            auto collect = [&changes](std::vector<wtl::service_change> const & delivered) { changes = delivered; };
+
+            // beta goes through start pending to running in one burst; alpha stops and comes back
+            scm.set_state(L"beta", SERVICE_START_PENDING);
+            scm.set_state(L"beta", SERVICE_RUNNING, 200);
+            scm.set_state(L"alpha", SERVICE_STOP_PENDING, 100);
+            scm.set_state(L"alpha", SERVICE_RUNNING, 100);
+
+            auto delivered = monitor.get().wait(collect, wtl::dword_milliseconds(1000));
+            Assert::IsTrue(delivered);
+            Assert::AreEqual(size_t(1), delivered.get());
+            Assert::IsTrue(changes[0].kind == wtl::service_change_kind::state_changed);
+            Assert::AreEqual(beta, changes[0].service);
+            Assert::AreEqual(DWORD(SERVICE_STOPPED), changes[0].previous_state);
+            Assert::AreEqual(DWORD(SERVICE_RUNNING), changes[0].status.dwCurrentState);
+            Assert::AreEqual(DWORD(200), monitor.get().status(beta).dwProcessId);
+
+            scm.add_service(L"gamma", SERVICE_STOPPED);
+            scm.remove_service(L"alpha");
+
+            changes.clear();
+            Assert::AreEqual(size_t(2), monitor.get().wait(collect, wtl::dword_milliseconds(1000)).get());
+            Assert::IsTrue(changes[0].kind == wtl::service_change_kind::created);
+            Assert::AreEqual(std::wstring(L"gamma"), monitor.get().name(changes[0].service));
+            Assert::IsTrue(changes[1].kind == wtl::service_change_kind::deleted);
+            Assert::AreEqual(alpha, changes[1].service);
+            Assert::IsFalse(monitor.get().present(alpha));
+
+            // gamma's watch reports its initial state as a delta from the created placeholder
+            changes.clear();
+            Assert::AreEqual(size_t(1), monitor.get().wait(collect, wtl::dword_milliseconds(1000)).get());
+            Assert::AreEqual(DWORD(SERVICE_STOPPED), changes[0].status.dwCurrentState);
+
+            // nothing changed: times out with no deltas and no re-enumeration
+            Assert::AreEqual(size_t(0), monitor.get().wait(collect, wtl::dword_milliseconds(10)).get());
+            Assert::AreEqual(size_t(1), scm.enumerate_calls());
+        }
+
+        TEST_METHOD(MonitorKeepsDeletionAndCreationApart)
+        {
+            wtl::fake_scm scm;
+            scm.add_service(L"alpha", SERVICE_RUNNING, 100);
+
+            auto monitor = wtl::basic_service_monitor<wtl::fake_scm>::create(scm);
+            Assert::IsTrue(monitor);
+
+            auto alpha = monitor.get().find(L"alpha");
+
+            // alpha is deleted and re-created, delta is created and deleted, all in one wait
+            scm.remove_service(L"alpha");
+            scm.add_service(L"alpha", SERVICE_STOPPED);
+            scm.add_service(L"delta", SERVICE_STOPPED);
+            scm.remove_service(L"delta");
+
+            std::vector<wtl::service_change> changes;
+            auto collect = [&changes](std::vector<wtl::service_change> const & delivered) { changes = delivered; };
+
+            Assert::AreEqual(size_t(4), monitor.get().wait(collect, wtl::dword_milliseconds(1000)).get());
+
+            auto delta = monitor.get().find(L"delta");
+
+            Assert::IsTrue(changes[0].kind == wtl::service_change_kind::deleted);
+            Assert::AreEqual(alpha, changes[0].service);
+            Assert::AreEqual(DWORD(SERVICE_RUNNING), changes[0].previous_state);
+            Assert::IsTrue(changes[1].kind == wtl::service_change_kind::created);
+            Assert::AreEqual(alpha, changes[1].service);
+            Assert::IsTrue(changes[2].kind == wtl::service_change_kind::created);
+            Assert::AreEqual(delta, changes[2].service);
+            Assert::IsTrue(changes[3].kind == wtl::service_change_kind::deleted);
+            Assert::AreEqual(delta, changes[3].service);
+
+            Assert::IsTrue(monitor.get().present(alpha));
+            Assert::IsFalse(monitor.get().present(delta));
+        }
+
+        TEST_METHOD(MonitorIgnoresCreationOfKnownService)
+        {
+            wtl::fake_scm scm;
+            scm.add_service(L"alpha", SERVICE_RUNNING, 100);
+
+            auto monitor = wtl::basic_service_monitor<wtl::fake_scm>::create(scm);
+            Assert::IsTrue(monitor);
+
+            // a creation notification for a service already in the snapshot, as when it races
+            // with the enumeration
+            scm.add_service(L"alpha", SERVICE_RUNNING, 100);
+
+            size_t calls = 0;
+            auto count = [&calls](std::vector<wtl::service_change> const &) { calls++; };
+
+            Assert::AreEqual(size_t(0), monitor.get().wait(count, wtl::dword_milliseconds(1000)).get());
+            Assert::AreEqual(size_t(0), calls);
+
+            auto alpha = monitor.get().find(L"alpha");
+            Assert::IsTrue(monitor.get().present(alpha));
+            Assert::AreEqual(DWORD(SERVICE_RUNNING), monitor.get().status(alpha).dwCurrentState);
+            Assert::AreEqual(DWORD(100), monitor.get().status(alpha).dwProcessId);
+        }
+    };
+}
\ No newline at end of file
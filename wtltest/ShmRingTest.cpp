@@ -0,0 +1,147 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include <wtl\shm_ring.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace wtltest
+{
+    namespace
+    {
+        std::wstring ring_name(PCWSTR test)
+        {
+            return std::wstring(L"Local\\wtltest.") + test + L"." + std::to_wstring(::GetCurrentProcessId());
+        }
+
+        std::vector<std::string> drain(wtl::shm_ring_consumer & consumer)
+        {
+            std::vector<std::string> records;
+            auto consumed = consumer.consume([&](void const * data, std::uint32_t size)
+            {
+                records.emplace_back(static_cast<char const *>(data), size);
+            });
+
+            Assert::IsTrue(consumed);
+            Assert::AreEqual(records.size(), consumed.get());
+
+            return records;
+        }
+    }
+
+    TEST_CLASS(ShmRingTest)
+    {
+    public:
+
+        TEST_METHOD(RingPublishesBatches)
+        {
+            auto name = ring_name(L"batches");
+            auto producer = wtl::shm_ring_producer::create(name.c_str(), 256);
+            Assert::IsTrue(producer);
+            Assert::AreEqual(DWORD(ERROR_ALREADY_EXISTS), wtl::shm_ring_producer::create(name.c_str(), 256).get_result());
+
+            auto consumer = wtl::shm_ring_consumer::open(name.c_str());
+            Assert::IsTrue(consumer);
+
+            Assert::IsTrue(producer.get().try_push("one", 3));
+            Assert::IsTrue(producer.get().try_push("", 0));
+            Assert::IsTrue(producer.get().try_push("three", 5));
+
+            // staged records stay invisible until published
+            Assert::IsTrue(consumer.get().empty());
+            Assert::IsTrue(wtl::wait_result::timeout == consumer.get().wait(wtl::dword_milliseconds(0)).get());
+
+            Assert::IsTrue(producer.get().publish());
+            Assert::IsTrue(wtl::wait_result::signaled == consumer.get().wait(wtl::dword_milliseconds(0)).get());
+            Assert::IsTrue(std::vector<std::string>{ "one", "", "three" } == drain(consumer.get()));
+            Assert::IsTrue(consumer.get().empty());
+        }
+
+        TEST_METHOD(RingWrapsAndFills)
+        {
+            auto name = ring_name(L"wraps");
+            auto producer = wtl::shm_ring_producer::create(name.c_str(), 128);
+            Assert::IsTrue(producer);
+
+            auto consumer = wtl::shm_ring_consumer::open(name.c_str());
+            Assert::IsTrue(consumer);
+
+            std::string record(40, 'x');
+            Assert::IsFalse(producer.get().try_push(record.data(), producer.get().max_record_size() + 1));
+
+            // 48 bytes per record: the third does not fit until the consumer frees space
+            Assert::IsTrue(producer.get().try_write(record.data(), 40).get());
+            Assert::IsTrue(producer.get().try_write(record.data(), 40).get());
+
+            auto full = producer.get().try_write(record.data(), 40);
+            Assert::IsTrue(full);
+            Assert::IsFalse(full.get());
+
+            Assert::AreEqual(size_t(2), drain(consumer.get()).size());
+
+            // the next record starts at 96 and has to wrap to the start of the buffer
+            for (char c = 'a'; c < 'g'; c++)
+            {
+                record.assign(40, c);
+                Assert::IsTrue(producer.get().try_write(record.data(), 40).get());
+
+                auto records = drain(consumer.get());
+                Assert::AreEqual(size_t(1), records.size());
+                Assert::AreEqual(record, records[0]);
+            }
+        }
+
+        TEST_METHOD(RingWakesSleepingConsumer)
+        {
+            auto name = ring_name(L"wakes");
+            auto producer = wtl::shm_ring_producer::create(name.c_str(), 4096);
+            Assert::IsTrue(producer);
+
+            auto consumer = wtl::shm_ring_consumer::open(name.c_str());
+            Assert::IsTrue(consumer);
+
+            const std::uint32_t total = 10000;
+            auto & p = producer.get();
+            std::thread writer([&p, total]
+            {
+                for (std::uint32_t i = 0; i < total; )
+                {
+                    if (p.try_push(&i, sizeof(i)))
+                    {
+                        // publish in batches of 16
+                        if (++i % 16 == 0) p.publish();
+                    }
+                    else
+                    {
+                        p.publish();
+                        std::this_thread::yield();
+                    }
+                }
+
+                p.publish();
+            });
+
+            std::uint32_t expected = 0;
+            while (expected < total)
+            {
+                Assert::IsTrue(wtl::wait_result::signaled == consumer.get().wait(wtl::dword_milliseconds(5000)).get());
+
+                Assert::IsTrue(consumer.get().consume([&](void const * data, std::uint32_t size)
+                {
+                    std::uint32_t value;
+                    Assert::AreEqual(std::uint32_t(sizeof(value)), size);
+                    std::memcpy(&value, data, sizeof(value));
+                    Assert::AreEqual(expected++, value);
+                }));
+            }
+
+            writer.join();
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include <wtl\timer_wheel.h>
+
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace wtltest
+{
+    TEST_CLASS(TimerTest)
+    {
+    public:
+
+        TEST_METHOD(WaitableTimerFires)
+        {
+            auto timer = wtl::waitable_timer::create();
+            Assert::IsTrue(timer);
+
+            Assert::IsTrue(timer.get().set(std::chrono::microseconds(500)));
+            Assert::IsTrue(wtl::wait_result::signaled == timer.get().wait(wtl::dword_milliseconds(5000)).get());
+        }
+
+        TEST_METHOD(TimerWheelExpiresAcrossLevels)
+        {
+            auto wheel = wtl::timer_wheel::create(std::chrono::milliseconds(1));
+            Assert::IsTrue(wheel);
+
+            auto & w = wheel.get();
+            auto base = wtl::timer_wheel::clock::now();
+
+            Assert::IsTrue(w.arm(base + std::chrono::milliseconds(5), 1));
+            Assert::IsTrue(w.arm(base + std::chrono::milliseconds(300), 2));
+            Assert::IsTrue(w.arm(base + std::chrono::seconds(70), 3));
+
+            auto cancelled = w.arm(base + std::chrono::milliseconds(300), 4);
+            Assert::IsTrue(cancelled);
+            Assert::IsTrue(w.cancel(cancelled.get()));
+            Assert::IsFalse(w.cancel(cancelled.get()));
+            Assert::AreEqual(size_t(3), w.size());
+
+            std::vector<wtl::timer_wheel::key_type> expired;
+            auto collect = [&expired](std::vector<wtl::timer_wheel::key_type> const & batch)
+            {
+                expired.insert(expired.end(), batch.begin(), batch.end());
+            };
+
+            Assert::AreEqual(size_t(1), w.expire(collect, base + std::chrono::milliseconds(10)).get());
+            Assert::IsTrue(expired == std::vector<wtl::timer_wheel::key_type>{ 1 });
+
+            Assert::AreEqual(size_t(0), w.expire(collect, base + std::chrono::milliseconds(250)).get());
+            Assert::AreEqual(size_t(1), w.expire(collect, base + std::chrono::milliseconds(310)).get());
+            Assert::IsTrue(expired == std::vector<wtl::timer_wheel::key_type>{ 1, 2 });
+
+            Assert::AreEqual(size_t(0), w.expire(collect, base + std::chrono::seconds(69)).get());
+            Assert::AreEqual(size_t(1), w.expire(collect, base + std::chrono::seconds(71)).get());
+            Assert::IsTrue(expired == std::vector<wtl::timer_wheel::key_type>{ 1, 2, 3 });
+            Assert::AreEqual(size_t(0), w.size());
+        }
+
+        TEST_METHOD(TimerWheelNeverFiresEarly)
+        {
+            auto wheel = wtl::timer_wheel::create(std::chrono::milliseconds(10));
+            Assert::IsTrue(wheel);
+
+            auto & w = wheel.get();
+
+            // not a whole number of ticks from the wheel's epoch, whatever that turned out to be
+            auto deadline = wtl::timer_wheel::clock::now() + std::chrono::microseconds(15500);
+            Assert::IsTrue(w.arm(deadline, 1));
+
+            size_t fired = 0;
+            auto count = [&fired](std::vector<wtl::timer_wheel::key_type> const & batch) { fired += batch.size(); };
+
+            for (auto t = deadline - std::chrono::milliseconds(20); t < deadline; t += std::chrono::milliseconds(1))
+            {
+                Assert::IsTrue(w.expire(count, t));
+            }
+
+            Assert::IsTrue(w.expire(count, deadline - std::chrono::nanoseconds(1)));
+            Assert::AreEqual(size_t(0), fired);
+
+            Assert::AreEqual(size_t(1), w.expire(count, deadline + std::chrono::milliseconds(10)).get());
+            Assert::AreEqual(size_t(1), fired);
+        }
+    };
+}
\ No newline at end of file